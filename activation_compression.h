@@ -0,0 +1,316 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <c10/core/Allocator.h>
+#include <c10/core/CPUAllocator.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "activation_offload.h"
+
+// How a module keeps what its backward pass needs. With none, autograd saves every intermediate in float32 as
+// usual. The other modes save only the module's inputs, in the given form, and recompute the intermediates from
+// them during backward: lossless keeps the inputs exactly, bfloat16 halves them and int8 quarters them with one
+// scale per row. The lossy modes change gradients slightly; all modes need the module to be deterministic, i.e.
+// dropout 0.
+enum class ActivationStorage
+{
+    none,
+    lossless,
+    bfloat16,
+    int8
+};
+
+inline ActivationStorage parse_activation_storage(const std::string& name)
+{
+    if (name == "none")
+    {
+        return ActivationStorage::none;
+    }
+    if (name == "lossless")
+    {
+        return ActivationStorage::lossless;
+    }
+    if (name == "bfloat16")
+    {
+        return ActivationStorage::bfloat16;
+    }
+    if (name == "int8")
+    {
+        return ActivationStorage::int8;
+    }
+    throw std::invalid_argument("parse_activation_storage: " + name + " is not none, lossless, bfloat16 or int8.");
+}
+
+// Storage per module of NNImpl.
+struct ActivationStorageConfig
+{
+    ActivationStorage gatconv1 = ActivationStorage::none;
+    ActivationStorage gatconv2 = ActivationStorage::none;
+    ActivationStorage readout = ActivationStorage::none;
+};
+
+namespace activation_compression_detail
+{
+    using Body = std::function<torch::Tensor(const std::vector<torch::Tensor>&)>;
+
+    struct BodyHolder : torch::CustomClassHolder
+    {
+        explicit BodyHolder(Body body)
+            : body(std::move(body))
+        {
+        }
+
+        Body body;
+    };
+
+    // Stores x under `key` in ctx->saved_data in the form selected by storage, or spilled to offload if given.
+    inline void save_compressed(torch::autograd::AutogradContext* ctx, const std::string& key,
+                                const torch::Tensor& x, const ActivationStorage storage, ActivationOffload* offload)
+    {
+        ctx->saved_data[key + "_dtype"] = static_cast<int64_t>(x.scalar_type());
+        ctx->saved_data[key + "_sizes"] = x.sizes().vec();
+        const auto values = x.detach();
+        if (offload)
+        {
+            ctx->saved_data[key] = c10::IValue::make_capsule(offload->spill(values));
+        }
+        else if (storage == ActivationStorage::bfloat16 && x.is_floating_point())
+        {
+            ctx->saved_data[key] = values.to(torch::kBFloat16);
+        }
+        else if (storage == ActivationStorage::int8 && x.is_floating_point() && x.dim() > 0 && x.numel() > 0)
+        {
+            auto rows = values.reshape({-1, x.size(-1)});
+            auto scale = rows.abs().amax(1, true).clamp_min(1e-30) / 127.0;
+            ctx->saved_data[key] = (rows / scale).round_().to(torch::kChar);
+            ctx->saved_data[key + "_scale"] = scale;
+        }
+        else
+        {
+            ctx->saved_data[key] = values;
+        }
+    }
+
+    inline torch::Tensor load_compressed(torch::autograd::AutogradContext* ctx, const std::string& key)
+    {
+        const auto dtype = static_cast<torch::ScalarType>(ctx->saved_data[key + "_dtype"].toInt());
+        const auto sizes = ctx->saved_data[key + "_sizes"].toIntVector();
+        const auto& saved = ctx->saved_data[key];
+        if (saved.isCapsule())
+        {
+            return static_cast<OffloadedActivation*>(saved.toCapsule().get())->load();
+        }
+        auto x = saved.toTensor();
+        if (ctx->saved_data.count(key + "_scale") != 0)
+        {
+            x = x.to(dtype) * ctx->saved_data[key + "_scale"].toTensor();
+        }
+        return x.to(dtype).reshape(sizes);
+    }
+}
+
+// Runs body(inputs) saving only the inputs, compressed according to storage or spilled to offload, and reruns it
+// with autograd during backward. Gradients flow to the inputs and to parameters, which must be every tensor
+// requiring gradients that body reads besides its inputs (usually module->parameters()).
+class RecomputeFromCompressed : public torch::autograd::Function<RecomputeFromCompressed>
+{
+public:
+    static torch::Tensor forward(torch::autograd::AutogradContext* ctx, const activation_compression_detail::Body& body,
+                                 const ActivationStorage storage, ActivationOffload* offload,
+                                 torch::TensorList inputs, torch::TensorList parameters)
+    {
+        using namespace activation_compression_detail;
+        ctx->saved_data["body"] = c10::IValue::make_capsule(c10::make_intrusive<BodyHolder>(body));
+        ctx->saved_data["inputs"] = static_cast<int64_t>(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i)
+        {
+            save_compressed(ctx, "input" + std::to_string(i), inputs[i], storage, offload);
+        }
+        ctx->save_for_backward(parameters.vec());
+        // Function::apply runs forward without autograd, so body records no graph here.
+        return body(inputs.vec());
+    }
+
+    static torch::autograd::variable_list backward(torch::autograd::AutogradContext* ctx, torch::autograd::variable_list grad_outputs)
+    {
+        using namespace activation_compression_detail;
+        const auto& body = static_cast<BodyHolder*>(ctx->saved_data["body"].toCapsule().get())->body;
+        const auto num_inputs = static_cast<size_t>(ctx->saved_data["inputs"].toInt());
+        const auto parameters = ctx->get_saved_variables();
+
+        // needs_input_grad counts tensor arguments only; the result has one entry per argument of forward: body,
+        // storage, offload, then the inputs and the parameters.
+        std::vector<torch::Tensor> inputs;
+        std::vector<torch::Tensor> targets;
+        std::vector<size_t> target_index;
+        for (size_t i = 0; i < num_inputs; ++i)
+        {
+            auto input = load_compressed(ctx, "input" + std::to_string(i));
+            if (ctx->needs_input_grad(i))
+            {
+                input.requires_grad_(true);
+                targets.push_back(input);
+                target_index.push_back(3 + i);
+            }
+            inputs.push_back(input);
+        }
+        for (size_t i = 0; i < parameters.size(); ++i)
+        {
+            if (ctx->needs_input_grad(num_inputs + i))
+            {
+                targets.push_back(parameters[i]);
+                target_index.push_back(3 + num_inputs + i);
+            }
+        }
+
+        torch::autograd::variable_list result(3 + num_inputs + parameters.size());
+        if (targets.empty())
+        {
+            return result;
+        }
+        torch::Tensor output;
+        {
+            torch::AutoGradMode enable_grad(true);
+            output = body(inputs);
+        }
+        auto grads = torch::autograd::grad({output}, targets, {grad_outputs[0]}, false, false, true);
+        for (size_t i = 0; i < targets.size(); ++i)
+        {
+            result[target_index[i]] = grads[i];
+        }
+        return result;
+    }
+};
+
+// body(inputs), with the intermediates kept for backward according to storage, or recomputed from inputs spilled to
+// offload if one is given. Without autograd, or with neither, body runs directly.
+inline torch::Tensor run_with_activation_storage(const ActivationStorage storage,
+                                                 const activation_compression_detail::Body& body,
+                                                 const std::vector<torch::Tensor>& inputs,
+                                                 const std::vector<torch::Tensor>& parameters,
+                                                 ActivationOffload* offload = nullptr)
+{
+    if ((storage == ActivationStorage::none && !offload) || !torch::GradMode::is_enabled())
+    {
+        return body(inputs);
+    }
+    return RecomputeFromCompressed::apply(body, storage, offload, torch::TensorList(inputs), torch::TensorList(parameters));
+}
+
+// Counts the live bytes of CPU tensor storage while installed, to measure the memory a forward pass keeps for
+// backward. Replaces the CPU allocator for its lifetime; meant for one-off measurements, not for use together with
+// other allocator wrappers.
+class LiveBytesScope
+{
+public:
+    // Same priority as PlanningAllocator, so that one can still install itself after this scope ends.
+    LiveBytesScope()
+    {
+        allocator.fallback = c10::GetCPUAllocator();
+        c10::SetCPUAllocator(&allocator, 1);
+    }
+
+    ~LiveBytesScope()
+    {
+        c10::SetCPUAllocator(allocator.fallback, 1);
+    }
+
+    // Bytes allocated while installed and not released yet.
+    int64_t live_bytes() const
+    {
+        return allocator.live->load();
+    }
+
+    LiveBytesScope(const LiveBytesScope&) = delete;
+    LiveBytesScope& operator=(const LiveBytesScope&) = delete;
+
+private:
+    struct Block
+    {
+        c10::DataPtr data;
+        std::shared_ptr<std::atomic<int64_t>> live;
+        int64_t bytes;
+    };
+
+    // Blocks keep the counter alive, so they may outlive the scope.
+    struct CountingAllocator final : c10::Allocator
+    {
+        c10::DataPtr allocate(size_t bytes) override
+        {
+            auto* block = new Block{fallback->allocate(bytes), live, static_cast<int64_t>(bytes)};
+            live->fetch_add(block->bytes);
+            void* data = block->data.get();
+            return {data, block, &release, c10::Device(c10::DeviceType::CPU)};
+        }
+
+        void copy_data(void* destination, const void* source, size_t count) const override
+        {
+            default_copy_data(destination, source, count);
+        }
+
+        static void release(void* context)
+        {
+            auto* block = static_cast<Block*>(context);
+            block->live->fetch_sub(block->bytes);
+            delete block;
+        }
+
+        c10::Allocator* fallback = nullptr;
+        std::shared_ptr<std::atomic<int64_t>> live = std::make_shared<std::atomic<int64_t>>(0);
+    };
+
+    CountingAllocator allocator;
+};
+
+struct ActivationCompressionReport
+{
+    int64_t saved_bytes_none = 0;        // memory kept for backward with plain autograd: storage none, no offload
+    int64_t saved_bytes_configured = 0;  // the same with the configured storage
+    double gradient_error = 0.0;         // ||g_configured - g_none|| / ||g_none|| over all parameters
+};
+
+// Trains nothing: runs one forward and backward pass of loss_fn(model(graph), labels) with storage none and with
+// `configured` (plus the model's activation offload, which the reference run disables), and compares the memory held
+// between forward and backward and the resulting gradients. Leaves the model's gradients zeroed, its storage set to
+// `configured` and its offload as it was.
+template <typename Model, typename Loss>
+ActivationCompressionReport compare_activation_storage(Model& model, const ActivationStorageConfig& configured, Loss& loss_fn,
+                                                       torch::Tensor edge_index, torch::Tensor node_attr, torch::Tensor edge_attr,
+                                                       torch::Tensor edge_weight, torch::Tensor labels)
+{
+    auto run = [&](const ActivationStorageConfig& storage, int64_t& saved_bytes)
+    {
+        model->set_activation_storage(storage);
+        model->zero_grad();
+        {
+            LiveBytesScope scope;
+            auto loss = loss_fn(model->forward(edge_index, node_attr, edge_attr, edge_weight), labels);
+            saved_bytes = scope.live_bytes();
+            loss.backward();
+        }
+        std::vector<torch::Tensor> grads;
+        for (const auto& parameter : model->parameters())
+        {
+            grads.push_back(parameter.grad().defined() ? parameter.grad().detach().reshape({-1}).clone()
+                                                       : torch::zeros({parameter.numel()}, parameter.options()));
+        }
+        return torch::cat(grads);
+    };
+
+    ActivationCompressionReport report;
+    const auto offload = model->get_activation_offload();
+    const auto offload_iterations = model->get_offload_iterations();
+    model->set_activation_offload(nullptr, 0);
+    auto reference = run(ActivationStorageConfig{}, report.saved_bytes_none);
+    model->set_activation_offload(offload, offload_iterations);
+    auto compressed = run(configured, report.saved_bytes_configured);
+    report.gradient_error = ((compressed - reference).norm() / reference.norm().clamp_min(1e-30)).item<double>();
+    model->zero_grad();
+    return report;
+}
@@ -0,0 +1,298 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Spills activations of a training step to an unlinked scratch file so that their memory is free until backward
+// needs them. Writes run on a background thread while the forward pass continues; written pages are flushed and
+// dropped from the page cache. Reads go through the mapping: backward prefetches each activation one step ahead of
+// its use, in reverse order of spilling, so disk reads overlap with the backward of the activation after it.
+namespace activation_offload_detail
+{
+    struct Region;
+
+    // Regions are allocated from the start of the file and recycled once all regions of a step are released.
+    struct ScratchFile
+    {
+        int fd = -1;
+        std::size_t page_size = 4096;
+        std::mutex mutex;
+        std::size_t end = 0;
+        std::size_t size = 0;
+        std::int64_t live = 0;
+        std::vector<Region*> order;  // in spilling order; nullptr once released
+
+        ~ScratchFile()
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+
+        void prefetch(std::size_t index);
+
+        void prefetch_latest()
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!order.empty())
+            {
+                prefetch_locked(order.size() - 1);
+            }
+        }
+
+        void prefetch_locked(std::size_t index);
+    };
+
+    // A page-aligned mapping of one activation's bytes in the scratch file.
+    struct Region
+    {
+        Region(std::shared_ptr<ScratchFile> file, const std::size_t bytes)
+            : file(std::move(file))
+        {
+            auto& scratch = *this->file;
+            std::lock_guard<std::mutex> lock(scratch.mutex);
+            length = (std::max<std::size_t>(bytes, 1) + scratch.page_size - 1) / scratch.page_size * scratch.page_size;
+            offset = scratch.end;
+            if (offset + length > scratch.size)
+            {
+                if (ftruncate(scratch.fd, static_cast<off_t>(offset + length)) != 0)
+                {
+                    throw std::runtime_error("ActivationOffload: cannot grow the scratch file.");
+                }
+                scratch.size = offset + length;
+            }
+            data = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, scratch.fd, static_cast<off_t>(offset));
+            if (data == MAP_FAILED)
+            {
+                throw std::runtime_error("ActivationOffload: cannot map the scratch file.");
+            }
+            scratch.end = offset + length;
+            index = scratch.order.size();
+            scratch.order.push_back(this);
+            ++scratch.live;
+        }
+
+        // Unlisted before unmapping, so a concurrent prefetch never advises a range that is gone or reused.
+        ~Region()
+        {
+            {
+                std::lock_guard<std::mutex> lock(file->mutex);
+                file->order[index] = nullptr;
+                if (--file->live == 0)
+                {
+                    file->end = 0;
+                    file->order.clear();
+                }
+            }
+            munmap(data, length);
+        }
+
+        Region(const Region&) = delete;
+        Region& operator=(const Region&) = delete;
+
+        std::shared_ptr<ScratchFile> file;
+        std::size_t offset = 0;
+        std::size_t length = 0;
+        std::size_t index = 0;
+        void* data = nullptr;
+    };
+
+    inline void ScratchFile::prefetch(const std::size_t index)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        prefetch_locked(index);
+    }
+
+    // Asynchronous readahead: the kernel starts reading the pages and returns.
+    inline void ScratchFile::prefetch_locked(const std::size_t index)
+    {
+        if (index < order.size() && order[index])
+        {
+            madvise(order[index]->data, order[index]->length, MADV_WILLNEED);
+        }
+    }
+}
+
+// An activation in the scratch file, held by the autograd context that needs it in backward.
+class OffloadedActivation : public torch::CustomClassHolder
+{
+public:
+    OffloadedActivation(std::shared_ptr<activation_offload_detail::ScratchFile> file, const torch::Tensor& x)
+        : region(std::make_shared<activation_offload_detail::Region>(std::move(file), x.numel() * x.element_size())),
+          sizes(x.sizes().vec()),
+          dtype(x.scalar_type()),
+          written(written_promise.get_future().share())
+    {
+    }
+
+    // Copies x into the file and evicts it from memory; runs on the offload thread.
+    void write(const torch::Tensor& x)
+    {
+        try
+        {
+            std::memcpy(region->data, x.data_ptr(), x.numel() * x.element_size());
+            const auto fd = region->file->fd;
+            const auto offset = static_cast<off64_t>(region->offset);
+            const auto length = static_cast<off64_t>(region->length);
+            if (sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER) != 0)
+            {
+                throw std::runtime_error("ActivationOffload: cannot write the scratch file.");
+            }
+            // Pages stay cached while mapped, so unmap them from this process before dropping them.
+            madvise(region->data, region->length, MADV_DONTNEED);
+            posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+            written_promise.set_value();
+        }
+        catch (...)
+        {
+            written_promise.set_exception(std::current_exception());
+        }
+    }
+
+    // The activation on the mapped pages, once written; the tensor keeps the mapping alive. Prefetches the
+    // activation spilled before this one, which backward needs next.
+    torch::Tensor load() const
+    {
+        written.get();
+        if (region->index > 0)
+        {
+            region->file->prefetch(region->index - 1);
+        }
+        auto mapping = region;
+        return torch::from_blob(region->data, sizes, [mapping](void*) {}, torch::TensorOptions().dtype(dtype));
+    }
+
+private:
+    std::shared_ptr<activation_offload_detail::Region> region;
+    std::vector<std::int64_t> sizes;
+    torch::ScalarType dtype;
+    std::promise<void> written_promise;
+    std::shared_future<void> written;
+};
+
+class ActivationOffload
+{
+public:
+    // The scratch file is created in directory and unlinked at once, so it disappears with the process. At most
+    // max_pending_bytes of activations wait for the offload thread; spill() blocks beyond that, which bounds the
+    // memory of a forward pass that outruns the disk.
+    explicit ActivationOffload(const std::string& directory, const std::int64_t max_pending_bytes = std::int64_t(256) << 20)
+        : file(std::make_shared<activation_offload_detail::ScratchFile>())
+    {
+        this->max_pending_bytes = max_pending_bytes;
+        auto path = directory + "/activations-XXXXXX";
+        file->fd = mkstemp(&path[0]);
+        if (file->fd < 0)
+        {
+            throw std::runtime_error("ActivationOffload::ActivationOffload: cannot create a scratch file in " + directory + ".");
+        }
+        unlink(path.c_str());
+        file->page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    }
+
+    ActivationOffload(const ActivationOffload&) = delete;
+    ActivationOffload& operator=(const ActivationOffload&) = delete;
+
+    // Finishes the pending writes before stopping the offload thread.
+    ~ActivationOffload()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        if (writer.joinable())
+        {
+            writer.join();
+        }
+    }
+
+    // Queues x for writing and returns its handle. x must not be modified in place until written.
+    c10::intrusive_ptr<OffloadedActivation> spill(const torch::Tensor& x)
+    {
+        auto values = x.detach().contiguous();
+        auto activation = c10::make_intrusive<OffloadedActivation>(file, values);
+        const auto bytes = values.numel() * static_cast<std::int64_t>(values.element_size());
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (!writer.joinable())
+            {
+                writer = std::thread([this]() { run(); });
+            }
+            condition.wait(lock, [&]() { return pending_bytes == 0 || pending_bytes + bytes <= max_pending_bytes; });
+            pending.push_back({activation, values});
+            pending_bytes += bytes;
+        }
+        condition.notify_all();
+        spilled_bytes += bytes;
+        return activation;
+    }
+
+    // Starts reading the most recently spilled activation, the first one backward will need.
+    void prefetch_latest()
+    {
+        file->prefetch_latest();
+    }
+
+    // Bytes written to the scratch file since construction.
+    std::int64_t total_spilled_bytes() const
+    {
+        return spilled_bytes.load();
+    }
+
+private:
+    struct Job
+    {
+        c10::intrusive_ptr<OffloadedActivation> activation;
+        torch::Tensor values;
+    };
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            condition.wait(lock, [this]() { return stopping || !pending.empty(); });
+            if (pending.empty())
+            {
+                return;
+            }
+            auto job = std::move(pending.front());
+            pending.pop_front();
+            lock.unlock();
+            job.activation->write(job.values);
+            const auto bytes = job.values.numel() * static_cast<std::int64_t>(job.values.element_size());
+            job = Job();
+            lock.lock();
+            pending_bytes -= bytes;
+            condition.notify_all();
+        }
+    }
+
+    std::shared_ptr<activation_offload_detail::ScratchFile> file;
+    std::int64_t max_pending_bytes;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Job> pending;
+    std::int64_t pending_bytes = 0;
+    bool stopping = false;
+    std::atomic<std::int64_t> spilled_bytes{0};
+    std::thread writer;
+};
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "cost_model.h"
+#include "inference.h"
+#include "threading.h"
+
+struct InferenceRequest
+{
+    std::int64_t graph_id;
+    std::int64_t version;
+    torch::Tensor edge_index;
+    torch::Tensor node_attr;
+    torch::Tensor edge_attr;
+    torch::Tensor edge_weight;
+    torch::Tensor query_edge_index;
+};
+
+struct AdaptiveExecutorStats
+{
+    std::uint64_t narrow_requests = 0;
+    std::uint64_t wide_requests = 0;
+};
+
+// Runs inference requests asynchronously with per-request intra-op parallelism. Requests the policy keeps
+// single-threaded go to a set of narrow workers, each pinned to its own core and running one request at a time;
+// requests large enough to benefit from intra-op parallelism go to a single wide worker, whose team runs on the
+// cores the narrow workers leave free (at most policy.max_threads() of them), so the two never share cores. With
+// no core left free the wide worker runs single-threaded.
+template <typename Model>
+class AdaptiveInferenceExecutor
+{
+public:
+    AdaptiveInferenceExecutor(InferenceEngine<Model>& engine, ParallelismPolicy policy, const int num_narrow_workers)
+        : engine(engine), policy(std::move(policy))
+    {
+        if (num_narrow_workers < 1)
+        {
+            throw std::invalid_argument("AdaptiveInferenceExecutor::AdaptiveInferenceExecutor: num_narrow_workers cannot be less than one.");
+        }
+
+        for (int i = 0; i < num_narrow_workers; ++i)
+        {
+            workers.emplace_back([this, i]()
+            {
+                pin_current_thread(static_cast<unsigned>(i));
+                set_intra_op_threads_for_current_thread(1);
+                run(narrow_queue);
+            });
+        }
+
+        const auto num_cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        const auto free_cores = num_cores - num_narrow_workers;
+        workers.emplace_back([this, num_narrow_workers, free_cores]()
+        {
+            int wide_threads = 1;
+            if (free_cores > 0)
+            {
+                wide_threads = std::min(this->policy.max_threads(), free_cores);
+                pin_current_thread_to_cores(static_cast<unsigned>(num_narrow_workers),
+                                            static_cast<unsigned>(num_narrow_workers + wide_threads));
+            }
+            set_intra_op_threads_for_current_thread(wide_threads);
+            run(wide_queue);
+        });
+    }
+
+    AdaptiveInferenceExecutor(const AdaptiveInferenceExecutor&) = delete;
+    AdaptiveInferenceExecutor& operator=(const AdaptiveInferenceExecutor&) = delete;
+
+    ~AdaptiveInferenceExecutor()
+    {
+        narrow_queue.close();
+        wide_queue.close();
+        for (auto& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    std::future<torch::Tensor> submit(InferenceRequest request)
+    {
+        Task task{std::move(request), std::promise<torch::Tensor>()};
+        auto result = task.promise.get_future();
+        if (policy.threads_for(task.request.node_attr.size(0), task.request.edge_index.size(1)) > 1)
+        {
+            ++wide_requests;
+            wide_queue.push(std::move(task));
+        }
+        else
+        {
+            ++narrow_requests;
+            narrow_queue.push(std::move(task));
+        }
+        return result;
+    }
+
+    AdaptiveExecutorStats stats() const
+    {
+        return AdaptiveExecutorStats{narrow_requests.load(), wide_requests.load()};
+    }
+
+private:
+    struct Task
+    {
+        InferenceRequest request;
+        std::promise<torch::Tensor> promise;
+    };
+
+    class TaskQueue
+    {
+    public:
+        void push(Task task)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                tasks.push_back(std::move(task));
+            }
+            condition.notify_one();
+        }
+
+        // Blocks until a task is available; returns false once the queue is closed and drained.
+        bool pop(Task& task)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return closed || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return false;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                closed = true;
+            }
+            condition.notify_all();
+        }
+
+    private:
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<Task> tasks;
+        bool closed = false;
+    };
+
+    void run(TaskQueue& queue)
+    {
+        Task task;
+        while (queue.pop(task))
+        {
+            try
+            {
+                const auto& request = task.request;
+                task.promise.set_value(engine.score(request.graph_id, request.version,
+                                                    request.edge_index, request.node_attr,
+                                                    request.edge_attr, request.edge_weight,
+                                                    request.query_edge_index));
+            }
+            catch (...)
+            {
+                task.promise.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    InferenceEngine<Model>& engine;
+    ParallelismPolicy policy;
+    TaskQueue narrow_queue;
+    TaskQueue wide_queue;
+    std::atomic<std::uint64_t> narrow_requests{0};
+    std::atomic<std::uint64_t> wide_requests{0};
+    std::vector<std::thread> workers;
+};
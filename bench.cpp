@@ -0,0 +1,225 @@
+#include <torch/torch.h>
+#include <yaml-cpp/yaml.h>
+#include <stdexcept>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <functional>
+
+#include "nn.h"
+#include "graph.h"
+#include "graph_generator.h"
+#include "model_config.h"
+#include "benchmark_store.h"
+
+// Performance regression harness: times the building blocks of training and inference with repetitions, appends
+// the samples to a JSON lines store under the current commit and compares them with a baseline commit. Exits
+// with status 2 when a benchmark is slower than the baseline by more than the threshold at 95 % confidence.
+
+// The trainer's generator with a fixed seed, so every commit times identical inputs.
+std::vector<Graph> make_benchmark_graphs(const int num_graphs, const double mean_size, const int node_attr_size)
+{
+    GraphGeneratorOptions options;
+    options.mean_nodes = mean_size;
+    options.stddev_nodes = mean_size / 10.0;
+    options.node_attr_size = node_attr_size;
+    options.seed = 12345;
+    torch::manual_seed(12345);
+    return GraphGenerator(options).generate(num_graphs);
+}
+
+// Commit the results are stored under: BENCH_COMMIT if set, otherwise the checked out git commit.
+std::string current_commit()
+{
+    if (const char* commit = std::getenv("BENCH_COMMIT"))
+    {
+        return commit;
+    }
+
+    std::string commit;
+    if (std::FILE* pipe = popen("git rev-parse --short HEAD 2>/dev/null", "r"))
+    {
+        char buffer[128];
+        while (std::fgets(buffer, sizeof(buffer), pipe))
+        {
+            commit += buffer;
+        }
+        pclose(pipe);
+    }
+    while (!commit.empty() && std::isspace(static_cast<unsigned char>(commit.back())))
+    {
+        commit.pop_back();
+    }
+    return commit.empty() ? "unknown" : commit;
+}
+
+// One sample per repetition: the mean wall time of `iterations` calls, after `warmup` untimed calls.
+std::vector<double> run_benchmark(const std::function<void(int)>& body, const int repetitions, const int iterations, const int warmup)
+{
+    for (int i = 0; i < warmup; ++i)
+    {
+        body(i);
+    }
+
+    std::vector<double> samples;
+    for (int repetition = 0; repetition < repetitions; ++repetition)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            body(repetition * iterations + i);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+        samples.push_back(elapsed.count() / iterations);
+    }
+    return samples;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3 && argc != 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " <config.yaml> <store.jsonl> [baseline commit]\n";
+        return 1;
+    }
+
+    YAML::Node config = YAML::LoadFile(argv[1]);
+    YAML::Node benchmark = config["benchmark"];
+    const int repetitions = std::max(2, benchmark["repetitions"].as<int>(10));
+    const int iterations = std::max(1, benchmark["iterations"].as<int>(20));
+    const int warmup = std::max(0, benchmark["warmup"].as<int>(5));
+    const double threshold = benchmark["threshold"].as<double>(0.05);
+    const int num_threads = benchmark["threads"].as<int>(0);
+    if (num_threads > 0)
+    {
+        torch::set_num_threads(num_threads);
+    }
+
+    const auto node_attr_size = config["node_attr_size"].as<int>(3);
+    const auto graphs = make_benchmark_graphs(benchmark["graphs"].as<int>(20), benchmark["graph_size"].as<double>(30.0), node_attr_size);
+    const auto graph = [&](const int i) -> const Graph& { return graphs[i % graphs.size()]; };
+
+    const auto edge_attr_size = config["edge_attr_size"].as<int>(3);
+    const auto output_node_attr_size = config["output_node_attr_size"].as<int>(32);
+    const auto hidden_sizes = config["hidden_sizes"].as<std::vector<int>>(std::vector<int>{64, 64});
+    const auto hidden_sizes_mlp = config["hidden_sizes_mlp"].as<std::vector<int>>(std::vector<int>{80, 80});
+
+    MLP<torch::nn::ReLU, torch::nn::Identity> mlp(2 * output_node_attr_size, hidden_sizes_mlp, 1);
+    GATConv<torch::nn::ReLU, torch::nn::Identity> gatconv(output_node_attr_size, hidden_sizes, output_node_attr_size,
+                                                          node_attr_size, edge_attr_size);
+    auto model = make_model(config);
+    torch::optim::Adam opt(model->parameters(), config["lr"].as<float>(1e-4f));
+    torch::nn::MSELoss loss_fn;
+
+    std::vector<torch::Tensor> edge_inputs;
+    std::vector<torch::Tensor> node_inputs;
+    for (const auto& g : graphs)
+    {
+        edge_inputs.push_back(torch::rand({g.edge_index.size(1), 2 * output_node_attr_size}));
+        node_inputs.push_back(torch::rand({g.node_attr.size(0), output_node_attr_size}));
+    }
+
+    std::vector<std::pair<std::string, std::function<void(int)>>> benchmarks = {
+        {"mlp_forward", [&](const int i)
+        {
+            torch::NoGradGuard no_grad;
+            mlp->forward(edge_inputs[i % graphs.size()]);
+        }},
+        {"gatconv_forward", [&](const int i)
+        {
+            torch::NoGradGuard no_grad;
+            const auto& g = graph(i);
+            gatconv->forward(g.edge_index, node_inputs[i % graphs.size()], g.edge_attr, g.edge_weight, g.node_attr);
+        }},
+        {"nn_forward", [&](const int i)
+        {
+            torch::NoGradGuard no_grad;
+            const auto& g = graph(i);
+            model->forward(g.edge_index, g.node_attr, g.edge_attr, g.edge_weight);
+        }},
+        {"nn_forward_backward", [&](const int i)
+        {
+            const auto& g = graph(i);
+            loss_fn(model->forward(g.edge_index, g.node_attr, g.edge_attr, g.edge_weight), g.edge_labels).backward();
+            model->zero_grad();
+        }},
+        {"training_step", [&](const int i)
+        {
+            const auto& g = graph(i);
+            loss_fn(model->forward(g.edge_index, g.node_attr, g.edge_attr, g.edge_weight), g.edge_labels).backward();
+            opt.step();
+            opt.zero_grad();
+        }},
+        {"inference_latency", [&](const int i)
+        {
+            torch::InferenceMode inference_mode;
+            const auto& g = graph(i);
+            model->forward(g.edge_index, g.node_attr, g.edge_attr, g.edge_weight);
+        }},
+    };
+
+    BenchmarkStore store(argv[2]);
+    const auto commit = current_commit();
+    std::string baseline = argc == 4 ? argv[3] : "";
+    if (baseline.empty())
+    {
+        // Latest stored commit other than the current one.
+        for (const auto& stored : store.commits())
+        {
+            if (stored != commit)
+            {
+                baseline = stored;
+            }
+        }
+    }
+    if (!baseline.empty() && !store.contains(baseline))
+    {
+        std::cerr << "No stored results for baseline commit " << baseline << ".\n";
+        return 1;
+    }
+
+    std::cout << "commit:\t" << commit << ";\tbaseline:\t" << (baseline.empty() ? "none" : baseline)
+              << ";\tthreads:\t" << torch::get_num_threads() << ";\trepetitions:\t" << repetitions << '\n';
+
+    bool regressed = false;
+    for (const auto& [name, body] : benchmarks)
+    {
+        if (name == "inference_latency")
+        {
+            model->eval();
+        }
+        auto samples = run_benchmark(body, repetitions, iterations, warmup);
+        store.append({commit, name, samples});
+
+        const auto summary = summarize(samples);
+        const double margin = student_t_975(static_cast<double>(summary.count - 1)) * summary.stddev / std::sqrt(static_cast<double>(summary.count));
+        std::cout << name << ":\t" << summary.mean * 1e3 << " ms +- " << margin * 1e3 << " ms";
+
+        if (!baseline.empty())
+        {
+            const auto& baseline_results = store.results_for(baseline);
+            auto it = baseline_results.find(name);
+            if (it != baseline_results.end() && it->second.size() >= 2)
+            {
+                const auto comparison = compare_samples(it->second, samples, threshold);
+                std::cout << ";\tchange:\t" << 100.0 * comparison.change << " % [" << 100.0 * comparison.lower << ", "
+                          << 100.0 * comparison.upper << "]" << (comparison.regressed ? "\tREGRESSION" : "");
+                regressed = regressed || comparison.regressed;
+            }
+        }
+        std::cout << '\n';
+    }
+
+    if (regressed)
+    {
+        std::cout << "Slower than " << baseline << " by more than " << 100.0 * threshold << " % at 95 % confidence.\n";
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Timing samples of one benchmark, one sample per repetition.
+struct BenchmarkResult
+{
+    std::string commit;
+    std::string benchmark;
+    std::vector<double> samples;
+};
+
+struct SampleSummary
+{
+    double mean = 0.0;
+    double stddev = 0.0;
+    std::size_t count = 0;
+};
+
+inline SampleSummary summarize(const std::vector<double>& samples)
+{
+    SampleSummary summary;
+    summary.count = samples.size();
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    for (auto sample : samples)
+    {
+        summary.mean += sample;
+    }
+    summary.mean /= static_cast<double>(samples.size());
+
+    if (samples.size() > 1)
+    {
+        double squares = 0.0;
+        for (auto sample : samples)
+        {
+            squares += (sample - summary.mean) * (sample - summary.mean);
+        }
+        summary.stddev = std::sqrt(squares / static_cast<double>(samples.size() - 1));
+    }
+    return summary;
+}
+
+// Two-sided 95 % quantile of Student's t distribution.
+inline double student_t_975(const double degrees_of_freedom)
+{
+    static const double table[] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+                                   2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+                                   2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degrees_of_freedom < 1.0)
+    {
+        return table[0];
+    }
+    if (degrees_of_freedom >= 30.0)
+    {
+        return 1.96 + 2.4 / degrees_of_freedom;
+    }
+    return table[static_cast<int>(degrees_of_freedom) - 1];
+}
+
+// Relative change of the current mean against the baseline mean with its 95 % confidence interval (Welch).
+struct BenchmarkComparison
+{
+    double change = 0.0;
+    double lower = 0.0;
+    double upper = 0.0;
+    bool regressed = false;
+};
+
+// A benchmark regresses when even the lower end of the interval is slower than the baseline by more than
+// threshold, so noisy runs need a larger slowdown before they fail.
+inline BenchmarkComparison compare_samples(const std::vector<double>& baseline, const std::vector<double>& current,
+                                           const double threshold)
+{
+    const auto base = summarize(baseline);
+    const auto now = summarize(current);
+    if (base.count < 2 || now.count < 2 || base.mean <= 0.0)
+    {
+        throw std::invalid_argument("compare_samples: need at least two samples per side and a positive baseline mean.");
+    }
+
+    const double base_variance = base.stddev * base.stddev / static_cast<double>(base.count);
+    const double now_variance = now.stddev * now.stddev / static_cast<double>(now.count);
+    const double standard_error = std::sqrt(base_variance + now_variance);
+    double degrees_of_freedom = static_cast<double>(base.count + now.count - 2);
+    if (standard_error > 0.0)
+    {
+        degrees_of_freedom = std::pow(base_variance + now_variance, 2)
+                             / (base_variance * base_variance / static_cast<double>(base.count - 1)
+                                + now_variance * now_variance / static_cast<double>(now.count - 1));
+    }
+
+    const double margin = student_t_975(degrees_of_freedom) * standard_error;
+    BenchmarkComparison comparison;
+    comparison.change = (now.mean - base.mean) / base.mean;
+    comparison.lower = (now.mean - base.mean - margin) / base.mean;
+    comparison.upper = (now.mean - base.mean + margin) / base.mean;
+    comparison.regressed = comparison.lower > threshold;
+    return comparison;
+}
+
+// Append-only store of benchmark results as JSON lines:
+//     {"commit": "1a2b3c4", "benchmark": "nn_forward", "samples": [0.0012, 0.0011]}
+// A later line for the same commit and benchmark replaces an earlier one.
+class BenchmarkStore
+{
+public:
+    explicit BenchmarkStore(const std::string& filename)
+    {
+        this->filename = filename;
+        std::ifstream in(filename);
+        std::string line;
+        int line_number = 0;
+        while (std::getline(in, line))
+        {
+            ++line_number;
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+            {
+                continue;
+            }
+            try
+            {
+                insert(parse_line(line));
+            }
+            catch (const std::invalid_argument& error)
+            {
+                throw std::invalid_argument("BenchmarkStore::BenchmarkStore: " + filename + ":" + std::to_string(line_number) + ": " + error.what());
+            }
+        }
+    }
+
+    void append(const BenchmarkResult& result)
+    {
+        std::ofstream out(filename, std::ios::app);
+        out.precision(17);
+        out << "{\"commit\": \"" << result.commit << "\", \"benchmark\": \"" << result.benchmark << "\", \"samples\": [";
+        for (std::size_t i = 0; i < result.samples.size(); ++i)
+        {
+            out << (i ? ", " : "") << result.samples[i];
+        }
+        out << "]}\n";
+        if (!out)
+        {
+            throw std::runtime_error("BenchmarkStore::append: cannot write " + filename + ".");
+        }
+        insert(result);
+    }
+
+    // Commits in the order they were first stored.
+    const std::vector<std::string>& commits() const
+    {
+        return commit_order;
+    }
+
+    bool contains(const std::string& commit) const
+    {
+        return results.count(commit) > 0;
+    }
+
+    // Benchmark name to samples for one commit.
+    const std::map<std::string, std::vector<double>>& results_for(const std::string& commit) const
+    {
+        auto it = results.find(commit);
+        if (it == results.end())
+        {
+            throw std::invalid_argument("BenchmarkStore::results_for: no results for commit " + commit + ".");
+        }
+        return it->second;
+    }
+
+private:
+    void insert(const BenchmarkResult& result)
+    {
+        if (!results.count(result.commit))
+        {
+            commit_order.push_back(result.commit);
+        }
+        results[result.commit][result.benchmark] = result.samples;
+    }
+
+    // Parses the flat objects written by append(); keys may appear in any order.
+    static BenchmarkResult parse_line(const std::string& line)
+    {
+        BenchmarkResult result;
+        std::size_t position = 0;
+        expect(line, position, '{');
+        for (;;)
+        {
+            const auto key = parse_string(line, position);
+            expect(line, position, ':');
+            if (key == "commit")
+            {
+                result.commit = parse_string(line, position);
+            }
+            else if (key == "benchmark")
+            {
+                result.benchmark = parse_string(line, position);
+            }
+            else if (key == "samples")
+            {
+                expect(line, position, '[');
+                skip_space(line, position);
+                if (position < line.size() && line[position] == ']')
+                {
+                    ++position;
+                }
+                else
+                {
+                    for (;;)
+                    {
+                        result.samples.push_back(parse_number(line, position));
+                        skip_space(line, position);
+                        if (position < line.size() && line[position] == ',')
+                        {
+                            ++position;
+                            continue;
+                        }
+                        expect(line, position, ']');
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                throw std::invalid_argument("unknown key \"" + key + "\".");
+            }
+
+            skip_space(line, position);
+            if (position < line.size() && line[position] == ',')
+            {
+                ++position;
+                continue;
+            }
+            expect(line, position, '}');
+            break;
+        }
+
+        if (result.commit.empty() || result.benchmark.empty())
+        {
+            throw std::invalid_argument("commit and benchmark are required.");
+        }
+        return result;
+    }
+
+    static void skip_space(const std::string& line, std::size_t& position)
+    {
+        while (position < line.size() && std::isspace(static_cast<unsigned char>(line[position])))
+        {
+            ++position;
+        }
+    }
+
+    static void expect(const std::string& line, std::size_t& position, const char c)
+    {
+        skip_space(line, position);
+        if (position >= line.size() || line[position] != c)
+        {
+            throw std::invalid_argument(std::string("expected '") + c + "' at column " + std::to_string(position + 1) + ".");
+        }
+        ++position;
+    }
+
+    // Commit ids and benchmark names never contain quotes or escapes, so neither are supported.
+    static std::string parse_string(const std::string& line, std::size_t& position)
+    {
+        expect(line, position, '"');
+        const auto end = line.find('"', position);
+        if (end == std::string::npos)
+        {
+            throw std::invalid_argument("unterminated string.");
+        }
+        auto value = line.substr(position, end - position);
+        position = end + 1;
+        return value;
+    }
+
+    static double parse_number(const std::string& line, std::size_t& position)
+    {
+        skip_space(line, position);
+        std::size_t length = 0;
+        double value;
+        try
+        {
+            value = std::stod(line.substr(position), &length);
+        }
+        catch (const std::exception&)
+        {
+            throw std::invalid_argument("expected a number at column " + std::to_string(position + 1) + ".");
+        }
+        position += length;
+        return value;
+    }
+
+    std::string filename;
+    std::vector<std::string> commit_order;
+    std::map<std::string, std::map<std::string, std::vector<double>>> results;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <atomic>
+#include <exception>
+#include <future>
+#include <memory>
+#include <utility>
+
+// Forces run_concurrently() on this thread to evaluate both branches in order, e.g. where the sequence of
+// allocations on the calling thread must not depend on thread timing.
+class SequentialBranchesGuard
+{
+public:
+    SequentialBranchesGuard()
+    {
+        previous = enabled();
+        enabled() = true;
+    }
+
+    ~SequentialBranchesGuard()
+    {
+        enabled() = previous;
+    }
+
+    static bool& enabled()
+    {
+        thread_local bool sequential = false;
+        return sequential;
+    }
+
+private:
+    bool previous;
+};
+
+// Evaluates two independent branches of a forward pass concurrently: `first` as a task on the inter-op pool,
+// `second` on the calling thread. at::launch carries the caller's grad mode and other thread-local state to the
+// task. If the task has not started once `second` is done, the calling thread claims and runs it itself, so a
+// busy pool (or a caller that is itself a pool thread) delays the result but cannot deadlock.
+template <typename First, typename Second>
+auto run_concurrently(First first, Second second) -> std::pair<decltype(first()), decltype(second())>
+{
+    if (SequentialBranchesGuard::enabled())
+    {
+        auto first_result = first();
+        return {std::move(first_result), second()};
+    }
+
+    struct Task
+    {
+        std::atomic<bool> claimed{false};
+        std::promise<decltype(first())> result;
+    };
+
+    auto task = std::make_shared<Task>();
+    auto future = task->result.get_future();
+    at::launch([task, first]() mutable
+    {
+        if (task->claimed.exchange(true))
+        {
+            return;
+        }
+        try
+        {
+            task->result.set_value(first());
+        }
+        catch (...)
+        {
+            task->result.set_exception(std::current_exception());
+        }
+    });
+
+    // The branches may refer to the caller's locals, so the task must be finished or claimed before unwinding.
+    decltype(second()) second_result;
+    std::exception_ptr second_error;
+    try
+    {
+        second_result = second();
+    }
+    catch (...)
+    {
+        second_error = std::current_exception();
+    }
+
+    if (!task->claimed.exchange(true))
+    {
+        if (second_error)
+        {
+            std::rethrow_exception(second_error);
+        }
+        return {first(), std::move(second_result)};
+    }
+
+    future.wait();
+    if (second_error)
+    {
+        std::rethrow_exception(second_error);
+    }
+    return {future.get(), std::move(second_result)};
+}
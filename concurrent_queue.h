@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// Bounded lock-free multi-producer multi-consumer queue (Vyukov's sequence-numbered ring buffer).
+// try_push/try_pop never block; push/pop back off (spin, yield, then sleep) while the queue is full or empty,
+// which gives producers backpressure from slow consumers. close() lets consumers drain the queue and stop.
+template <typename T>
+class ConcurrentQueue
+{
+public:
+    explicit ConcurrentQueue(const std::size_t min_capacity)
+    {
+        if (min_capacity < 2)
+        {
+            throw std::invalid_argument("ConcurrentQueue::ConcurrentQueue: min_capacity cannot be less than two.");
+        }
+
+        capacity = 2;
+        while (capacity < min_capacity)
+        {
+            capacity *= 2;
+        }
+        mask = capacity - 1;
+        cells = std::make_unique<Cell[]>(capacity);
+        for (std::size_t i = 0; i < capacity; ++i)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ConcurrentQueue(const ConcurrentQueue&) = delete;
+    ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+    bool try_push(T& value)
+    {
+        std::size_t position = enqueue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[position & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0)
+            {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = enqueue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T& value)
+    {
+        std::size_t position = dequeue_position.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[position & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const auto difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0)
+            {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(position + capacity, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false;
+            }
+            else
+            {
+                position = dequeue_position.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocks while the queue is full. Pushing to a closed queue is a logic error.
+    void push(T value)
+    {
+        if (closed.load(std::memory_order_acquire))
+        {
+            throw std::logic_error("ConcurrentQueue::push: the queue is closed.");
+        }
+
+        for (unsigned attempt = 0; !try_push(value); ++attempt)
+        {
+            back_off(attempt);
+        }
+    }
+
+    // Blocks while the queue is empty; returns false once the queue is closed and drained.
+    bool pop(T& value)
+    {
+        for (unsigned attempt = 0; ; ++attempt)
+        {
+            if (try_pop(value))
+            {
+                return true;
+            }
+
+            if (closed.load(std::memory_order_acquire))
+            {
+                // A producer may have completed its push right before closing.
+                return try_pop(value);
+            }
+            back_off(attempt);
+        }
+    }
+
+    void close()
+    {
+        closed.store(true, std::memory_order_release);
+    }
+
+    bool is_closed() const
+    {
+        return closed.load(std::memory_order_acquire);
+    }
+
+    // Approximate number of queued items, for monitoring only.
+    std::size_t size_approx() const
+    {
+        const auto enqueued = enqueue_position.load(std::memory_order_relaxed);
+        const auto dequeued = dequeue_position.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<std::size_t> sequence{0};
+        T value{};
+    };
+
+    static void back_off(const unsigned attempt)
+    {
+        if (attempt < 64)
+        {
+            return;
+        }
+
+        if (attempt < 128)
+        {
+            std::this_thread::yield();
+            return;
+        }
+
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    static constexpr std::size_t cache_line_size = 64;
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t capacity = 0;
+    std::size_t mask = 0;
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_position{0};
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_position{0};
+    alignas(cache_line_size) std::atomic<bool> closed{false};
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+// Connected components of the graph kept by thresholding edge scores, e.g. to turn edge predictions into track
+// candidates. A concurrent union-find processes the kept edges under at::parallel_for without locks: roots are
+// only ever linked to smaller roots by compare-and-swap, so every parent pointer decreases monotonically, finds
+// may halve paths with plain CAS, and the root of a component is its smallest node index.
+class ConcurrentUnionFind
+{
+public:
+    explicit ConcurrentUnionFind(const std::int64_t num_nodes)
+        : parent(new std::atomic<std::int64_t>[num_nodes])
+    {
+        this->num_nodes = num_nodes;
+        at::parallel_for(0, num_nodes, 16384, [&](std::int64_t begin, std::int64_t end)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                parent[i].store(i, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    std::int64_t find(std::int64_t node)
+    {
+        while (true)
+        {
+            auto up = parent[node].load(std::memory_order_relaxed);
+            if (up == node)
+            {
+                return node;
+            }
+            const auto grandparent = parent[up].load(std::memory_order_relaxed);
+            if (grandparent != up)
+            {
+                // A failed exchange only means another thread shortened the path first.
+                parent[node].compare_exchange_weak(up, grandparent, std::memory_order_relaxed);
+            }
+            node = grandparent;
+        }
+    }
+
+    void unite(std::int64_t a, std::int64_t b)
+    {
+        while (true)
+        {
+            a = find(a);
+            b = find(b);
+            if (a == b)
+            {
+                return;
+            }
+            if (a < b)
+            {
+                std::swap(a, b);
+            }
+            // Fails if a stopped being a root in the meantime; retry from the new roots.
+            auto expected = a;
+            if (parent[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+    }
+
+    // Root of every node, i.e. the smallest node index of its component: [num_nodes], int64.
+    torch::Tensor labels()
+    {
+        auto labels = torch::empty({num_nodes}, torch::kLong);
+        auto* data = labels.data_ptr<std::int64_t>();
+        at::parallel_for(0, num_nodes, 16384, [&](std::int64_t begin, std::int64_t end)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                data[i] = find(i);
+            }
+        });
+        return labels;
+    }
+
+private:
+    std::unique_ptr<std::atomic<std::int64_t>[]> parent;
+    std::int64_t num_nodes = 0;
+};
+
+// Component id of every node when only edges with score >= threshold connect nodes. edge_index is [2, E] and
+// scores [E] or [E, 1]; nodes without kept edges are their own component. Ids are the smallest node index of each
+// component, so they are deterministic and, for a disjoint union of graphs, never shared between graphs.
+inline torch::Tensor connected_components(torch::Tensor edge_index, torch::Tensor scores, const std::int64_t num_nodes,
+                                          const double threshold)
+{
+    if (edge_index.dim() != 2 || edge_index.size(0) != 2 || scores.numel() != edge_index.size(1))
+    {
+        throw std::invalid_argument("connected_components: edge_index must be [2, E] with one score per edge.");
+    }
+
+    auto edges = edge_index.to(torch::kLong).contiguous();
+    auto edge_scores = scores.reshape({-1}).to(torch::kFloat).contiguous();
+    const auto* sources = edges.data_ptr<std::int64_t>();
+    const auto* targets = sources + edges.size(1);
+    const auto* score_data = edge_scores.data_ptr<float>();
+    const auto cut = static_cast<float>(threshold);
+
+    ConcurrentUnionFind components(num_nodes);
+    at::parallel_for(0, edges.size(1), 4096, [&](std::int64_t begin, std::int64_t end)
+    {
+        for (auto e = begin; e < end; ++e)
+        {
+            if (score_data[e] >= cut)
+            {
+                components.unite(sources[e], targets[e]);
+            }
+        }
+    });
+    return components.labels();
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "threading.h"
+
+// Least-squares fit of seconds = a + b * num_nodes + c * num_edges from measured samples.
+class LinearCostModel
+{
+public:
+    void add_sample(const std::int64_t num_nodes, const std::int64_t num_edges, const double seconds)
+    {
+        samples.push_back({static_cast<double>(num_nodes), static_cast<double>(num_edges), seconds});
+    }
+
+    void fit()
+    {
+        if (samples.empty())
+        {
+            throw std::logic_error("LinearCostModel::fit: no samples were added.");
+        }
+
+        // Normal equations of the 3-parameter fit; fall back to a single per-element rate when the samples do not
+        // span enough sizes to determine all three coefficients.
+        double ata[3][3] = {{0.0}};
+        double atb[3] = {0.0};
+        for (const auto& sample : samples)
+        {
+            const double x[3] = {1.0, sample[0], sample[1]};
+            for (int i = 0; i < 3; ++i)
+            {
+                for (int j = 0; j < 3; ++j)
+                {
+                    ata[i][j] += x[i] * x[j];
+                }
+                atb[i] += x[i] * sample[2];
+            }
+        }
+
+        if (solve(ata, atb) && atb[0] >= 0.0 && atb[1] >= 0.0 && atb[2] >= 0.0)
+        {
+            coefficients = {atb[0], atb[1], atb[2]};
+        }
+        else
+        {
+            double seconds = 0.0;
+            double elements = 0.0;
+            for (const auto& sample : samples)
+            {
+                seconds += sample[2];
+                elements += sample[0] + sample[1];
+            }
+            const double rate = elements > 0.0 ? seconds / elements : 0.0;
+            coefficients = {elements > 0.0 ? 0.0 : seconds / static_cast<double>(samples.size()), rate, rate};
+        }
+        fitted = true;
+    }
+
+    double predict(const std::int64_t num_nodes, const std::int64_t num_edges) const
+    {
+        if (!fitted)
+        {
+            throw std::logic_error("LinearCostModel::predict: the model has not been fitted.");
+        }
+        return coefficients[0] + coefficients[1] * static_cast<double>(num_nodes)
+                               + coefficients[2] * static_cast<double>(num_edges);
+    }
+
+    bool is_fitted() const
+    {
+        return fitted;
+    }
+
+private:
+    static bool solve(double a[3][3], double b[3])
+    {
+        for (int col = 0; col < 3; ++col)
+        {
+            int pivot = col;
+            for (int row = col + 1; row < 3; ++row)
+            {
+                if (std::abs(a[row][col]) > std::abs(a[pivot][col]))
+                {
+                    pivot = row;
+                }
+            }
+
+            if (std::abs(a[pivot][col]) < 1e-12 * std::max(1.0, std::abs(a[0][0])))
+            {
+                return false;
+            }
+
+            std::swap(a[col], a[pivot]);
+            std::swap(b[col], b[pivot]);
+            for (int row = 0; row < 3; ++row)
+            {
+                if (row != col)
+                {
+                    const double factor = a[row][col] / a[col][col];
+                    for (int j = col; j < 3; ++j)
+                    {
+                        a[row][j] -= factor * a[col][j];
+                    }
+                    b[row] -= factor * b[col];
+                }
+            }
+        }
+
+        for (int i = 0; i < 3; ++i)
+        {
+            b[i] /= a[i][i];
+        }
+        return true;
+    }
+
+    std::vector<std::array<double, 3>> samples;
+    std::array<double, 3> coefficients = {0.0, 0.0, 0.0};
+    bool fitted = false;
+};
+
+// Predicted wall time of the stages of NN inference: gatconv1, one gatconv2 iteration and the readout.
+// Predictions are inflated by safety_margin to absorb timing noise.
+class IterationCostModel
+{
+public:
+    explicit IterationCostModel(const double safety_margin = 0.2)
+    {
+        if (safety_margin < 0.0)
+        {
+            throw std::invalid_argument("IterationCostModel::IterationCostModel: safety_margin cannot be negative.");
+        }
+        this->safety_margin = safety_margin;
+    }
+
+    double predict_iteration(const int iteration, const std::int64_t num_nodes, const std::int64_t num_edges) const
+    {
+        const auto& stage = iteration == 0 ? first_iteration : iteration_stage;
+        return (1.0 + safety_margin) * stage.predict(num_nodes, num_edges);
+    }
+
+    double predict_readout(const std::int64_t num_nodes, const std::int64_t num_edges) const
+    {
+        return (1.0 + safety_margin) * readout_stage.predict(num_nodes, num_edges);
+    }
+
+    bool is_calibrated() const
+    {
+        return first_iteration.is_fitted() && iteration_stage.is_fitted() && readout_stage.is_fitted();
+    }
+
+    // Times every stage of model on the given graphs (after one untimed warmup pass) and fits the stage models.
+    template <typename Model>
+    void calibrate(Model& model,
+                   const std::vector<torch::Tensor>& edge_index,
+                   const std::vector<torch::Tensor>& node_attr,
+                   const std::vector<torch::Tensor>& edge_attr,
+                   const std::vector<torch::Tensor>& edge_weight,
+                   const int repetitions = 3)
+    {
+        if (edge_index.empty())
+        {
+            throw std::invalid_argument("IterationCostModel::calibrate: at least one graph is required.");
+        }
+
+        torch::NoGradGuard no_grad;
+        using clock = std::chrono::steady_clock;
+        for (int repetition = -1; repetition < repetitions; ++repetition)
+        {
+            for (size_t i = 0; i < edge_index.size(); ++i)
+            {
+                const auto num_nodes = node_attr[i].size(0);
+                const auto num_edges = edge_index[i].size(1);
+
+                auto t0 = clock::now();
+                auto output_node_attr = model->iterate(0, edge_index[i], node_attr[i], edge_attr[i], edge_weight[i], node_attr[i]);
+                auto t1 = clock::now();
+                output_node_attr = model->iterate(1, edge_index[i], output_node_attr, edge_attr[i], edge_weight[i], node_attr[i]);
+                auto t2 = clock::now();
+                model->readout(edge_index[i], output_node_attr);
+                auto t3 = clock::now();
+
+                if (repetition >= 0)
+                {
+                    first_iteration.add_sample(num_nodes, num_edges, std::chrono::duration<double>(t1 - t0).count());
+                    iteration_stage.add_sample(num_nodes, num_edges, std::chrono::duration<double>(t2 - t1).count());
+                    readout_stage.add_sample(num_nodes, num_edges, std::chrono::duration<double>(t3 - t2).count());
+                }
+            }
+        }
+
+        first_iteration.fit();
+        iteration_stage.fit();
+        readout_stage.fit();
+    }
+
+private:
+    double safety_margin;
+    LinearCostModel first_iteration;
+    LinearCostModel iteration_stage;
+    LinearCostModel readout_stage;
+};
+
+// Chooses the intra-op parallelism of an inference request from its size. Calibration times NN forward passes
+// single-threaded and with wide_threads threads; a request runs wide only when the predicted speedup keeps at
+// least min_parallel_efficiency of the wide threads busy, otherwise the cores are better spent on running
+// several narrow requests concurrently.
+class ParallelismPolicy
+{
+public:
+    explicit ParallelismPolicy(const int wide_threads, const double min_parallel_efficiency = 0.5)
+    {
+        if (wide_threads < 1)
+        {
+            throw std::invalid_argument("ParallelismPolicy::ParallelismPolicy: wide_threads cannot be less than one.");
+        }
+
+        if (min_parallel_efficiency <= 0.0 || min_parallel_efficiency > 1.0)
+        {
+            throw std::invalid_argument("ParallelismPolicy::ParallelismPolicy: min_parallel_efficiency must be in (0, 1].");
+        }
+
+        this->wide_threads = wide_threads;
+        this->min_parallel_efficiency = min_parallel_efficiency;
+    }
+
+    template <typename Model>
+    void calibrate(Model& model,
+                   const std::vector<torch::Tensor>& edge_index,
+                   const std::vector<torch::Tensor>& node_attr,
+                   const std::vector<torch::Tensor>& edge_attr,
+                   const std::vector<torch::Tensor>& edge_weight,
+                   const int repetitions = 3)
+    {
+        if (edge_index.empty())
+        {
+            throw std::invalid_argument("ParallelismPolicy::calibrate: at least one graph is required.");
+        }
+
+        auto time_forward_passes = [&](LinearCostModel& stage, const int num_threads)
+        {
+            set_intra_op_threads_for_current_thread(num_threads);
+            torch::NoGradGuard no_grad;
+            for (int repetition = -1; repetition < repetitions; ++repetition)
+            {
+                for (size_t i = 0; i < edge_index.size(); ++i)
+                {
+                    auto t0 = std::chrono::steady_clock::now();
+                    model->forward(edge_index[i], node_attr[i], edge_attr[i], edge_weight[i]);
+                    auto t1 = std::chrono::steady_clock::now();
+                    if (repetition >= 0)
+                    {
+                        stage.add_sample(node_attr[i].size(0), edge_index[i].size(1), std::chrono::duration<double>(t1 - t0).count());
+                    }
+                }
+            }
+            stage.fit();
+        };
+
+        // Both timings run on scratch threads so the caller's own thread setting is left alone.
+        std::thread narrow_thread([&]() { time_forward_passes(narrow, 1); });
+        narrow_thread.join();
+        std::thread wide_thread([&]() { time_forward_passes(wide, wide_threads); });
+        wide_thread.join();
+    }
+
+    int threads_for(const std::int64_t num_nodes, const std::int64_t num_edges) const
+    {
+        if (wide_threads == 1 || !narrow.is_fitted() || !wide.is_fitted())
+        {
+            return 1;
+        }
+
+        const double speedup = narrow.predict(num_nodes, num_edges) / std::max(wide.predict(num_nodes, num_edges), 1e-12);
+        return speedup >= min_parallel_efficiency * wide_threads ? wide_threads : 1;
+    }
+
+    int max_threads() const
+    {
+        return wide_threads;
+    }
+
+private:
+    int wide_threads;
+    double min_parallel_efficiency;
+    LinearCostModel narrow;
+    LinearCostModel wide;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+struct EmbeddingCacheStats
+{
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t insertions = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t invalidations = 0;
+    std::size_t entries = 0;
+    std::size_t memory_bytes = 0;
+    std::size_t memory_budget_bytes = 0;
+
+    double hit_rate() const
+    {
+        const auto lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+    }
+};
+
+// LRU cache of output_node_attr keyed by graph id. Only the latest version of a graph is kept: looking up or
+// inserting a newer version drops the stale embeddings, so a graph update invalidates its entry implicitly. Requests
+// for an older version, e.g. from a concurrent request that raced an update, miss without touching the entry.
+class EmbeddingCache
+{
+public:
+    explicit EmbeddingCache(const std::size_t memory_budget_bytes)
+    {
+        this->memory_budget_bytes = memory_budget_bytes;
+    }
+
+    std::optional<torch::Tensor> get(const std::int64_t graph_id, const std::int64_t version)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(graph_id);
+        if (it == index.end())
+        {
+            ++misses;
+            return std::nullopt;
+        }
+
+        if (it->second->version != version)
+        {
+            if (it->second->version < version)
+            {
+                erase(it->second);
+                ++invalidations;
+            }
+            ++misses;
+            return std::nullopt;
+        }
+
+        lru.splice(lru.begin(), lru, it->second);
+        ++hits;
+        return lru.front().output_node_attr;
+    }
+
+    void put(const std::int64_t graph_id, const std::int64_t version, const torch::Tensor& output_node_attr)
+    {
+        const std::size_t bytes = output_node_attr.nbytes();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(graph_id);
+        if (it != index.end())
+        {
+            if (it->second->version > version)
+            {
+                return;
+            }
+            erase(it->second);
+        }
+
+        // An entry larger than the whole budget would only flush everything else and be evicted next.
+        if (bytes > memory_budget_bytes)
+        {
+            return;
+        }
+
+        while (memory_bytes + bytes > memory_budget_bytes)
+        {
+            erase(std::prev(lru.end()));
+            ++evictions;
+        }
+
+        lru.push_front(Entry{graph_id, version, output_node_attr.detach(), bytes});
+        index[graph_id] = lru.begin();
+        memory_bytes += bytes;
+        ++insertions;
+    }
+
+    void invalidate(const std::int64_t graph_id)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = index.find(graph_id);
+        if (it != index.end())
+        {
+            erase(it->second);
+            ++invalidations;
+        }
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        lru.clear();
+        index.clear();
+        memory_bytes = 0;
+    }
+
+    EmbeddingCacheStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EmbeddingCacheStats result;
+        result.hits = hits;
+        result.misses = misses;
+        result.insertions = insertions;
+        result.evictions = evictions;
+        result.invalidations = invalidations;
+        result.entries = lru.size();
+        result.memory_bytes = memory_bytes;
+        result.memory_budget_bytes = memory_budget_bytes;
+        return result;
+    }
+
+private:
+    struct Entry
+    {
+        std::int64_t graph_id;
+        std::int64_t version;
+        torch::Tensor output_node_attr;
+        std::size_t bytes;
+    };
+
+    using EntryList = std::list<Entry>;
+
+    void erase(EntryList::iterator it)
+    {
+        memory_bytes -= it->bytes;
+        index.erase(it->graph_id);
+        lru.erase(it);
+    }
+
+    mutable std::mutex mutex;
+    EntryList lru;
+    std::unordered_map<std::int64_t, EntryList::iterator> index;
+    std::size_t memory_budget_bytes = 0;
+    std::size_t memory_bytes = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t insertions = 0;
+    std::uint64_t evictions = 0;
+    std::uint64_t invalidations = 0;
+};
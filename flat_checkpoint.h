@@ -0,0 +1,223 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "npy_loader.h"
+
+// Checkpoints whose parameters and buffers are stored flat, in native layout and 64-byte aligned, so a process
+// can map the file read-only and use the tensors in place. Loading costs one mmap and no copy, and all processes
+// serving the same checkpoint share one physical copy of the weights through the page cache. Layout:
+//
+//     "NNFLAT01", u64 entry count, then per entry: u32 name length, name, u8 dtype, u8 dimensions,
+//     i64 size per dimension, u64 data offset, u64 data bytes; data from the first page boundary on.
+//
+// Integers are little-endian. Loaded tensors are read-only: the model can run inference but not be trained.
+
+namespace flat_checkpoint_detail
+{
+    constexpr char magic[8] = {'N', 'N', 'F', 'L', 'A', 'T', '0', '1'};
+    constexpr std::uint64_t data_alignment = 64;
+    constexpr std::uint64_t page_size = 4096;
+
+    struct Entry
+    {
+        std::string name;
+        torch::ScalarType dtype = torch::kFloat;
+        std::vector<std::int64_t> sizes;
+        std::uint64_t offset = 0;
+        std::uint64_t bytes = 0;
+    };
+
+    inline std::uint64_t align(const std::uint64_t value, const std::uint64_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    template <typename T>
+    void append(std::string& out, const T value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template <typename T>
+    T take(const std::uint8_t* data, const std::size_t size, std::size_t& position)
+    {
+        if (position + sizeof(T) > size)
+        {
+            throw std::runtime_error("load_flat_checkpoint: truncated index.");
+        }
+        T value;
+        std::memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    // Parameters and buffers under their fully qualified names, as torch::save names them.
+    inline std::vector<std::pair<std::string, torch::Tensor>> named_tensors(const torch::nn::Module& module)
+    {
+        std::vector<std::pair<std::string, torch::Tensor>> tensors;
+        for (const auto& item : module.named_parameters(true))
+        {
+            tensors.emplace_back(item.key(), item.value());
+        }
+        for (const auto& item : module.named_buffers(true))
+        {
+            tensors.emplace_back(item.key(), item.value());
+        }
+        return tensors;
+    }
+}
+
+// Writes to a temporary file that is renamed over `path`: processes that still map the old checkpoint keep
+// reading its unchanged inode instead of seeing a half-written file.
+inline void save_flat_checkpoint(const torch::nn::Module& module, const std::string& path)
+{
+    using namespace flat_checkpoint_detail;
+    std::vector<Entry> entries;
+    std::vector<torch::Tensor> tensors;
+    for (const auto& item : named_tensors(module))
+    {
+        auto tensor = item.second.detach().to(torch::kCPU).contiguous();
+        entries.push_back({item.first, tensor.scalar_type(), tensor.sizes().vec(), 0,
+                           static_cast<std::uint64_t>(tensor.numel() * tensor.element_size())});
+        tensors.push_back(tensor);
+    }
+
+    std::uint64_t index_bytes = sizeof(magic) + sizeof(std::uint64_t);
+    for (const auto& entry : entries)
+    {
+        index_bytes += sizeof(std::uint32_t) + entry.name.size() + 2 + sizeof(std::int64_t) * entry.sizes.size()
+                       + 2 * sizeof(std::uint64_t);
+    }
+    std::uint64_t offset = align(index_bytes, page_size);
+    for (auto& entry : entries)
+    {
+        entry.offset = offset;
+        offset = align(offset + entry.bytes, data_alignment);
+    }
+
+    std::string index(magic, sizeof(magic));
+    append<std::uint64_t>(index, entries.size());
+    for (const auto& entry : entries)
+    {
+        append<std::uint32_t>(index, static_cast<std::uint32_t>(entry.name.size()));
+        index += entry.name;
+        append<std::uint8_t>(index, static_cast<std::uint8_t>(entry.dtype));
+        append<std::uint8_t>(index, static_cast<std::uint8_t>(entry.sizes.size()));
+        for (const auto size : entry.sizes)
+        {
+            append<std::int64_t>(index, size);
+        }
+        append<std::uint64_t>(index, entry.offset);
+        append<std::uint64_t>(index, entry.bytes);
+    }
+
+    const auto temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            throw std::runtime_error("save_flat_checkpoint: cannot open " + temporary + ".");
+        }
+        out.write(index.data(), static_cast<std::streamsize>(index.size()));
+        std::uint64_t position = index.size();
+        const std::vector<char> padding(page_size, 0);
+        for (std::size_t i = 0; i < entries.size(); ++i)
+        {
+            out.write(padding.data(), static_cast<std::streamsize>(entries[i].offset - position));
+            out.write(static_cast<const char*>(tensors[i].data_ptr()), static_cast<std::streamsize>(entries[i].bytes));
+            position = entries[i].offset + entries[i].bytes;
+        }
+        if (!out)
+        {
+            throw std::runtime_error("save_flat_checkpoint: cannot write " + temporary + ".");
+        }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        throw std::runtime_error("save_flat_checkpoint: cannot rename " + temporary + " to " + path + ".");
+    }
+}
+
+// Points every parameter and buffer of `module` at its data in the mapped file. The tensors keep the mapping
+// alive; names, dtypes and shapes must match the module exactly. The mapping is read-only, so the module is for
+// inference only: its parameters stop requiring gradients and must not be modified in place.
+inline void load_flat_checkpoint(torch::nn::Module& module, const std::string& path)
+{
+    using namespace flat_checkpoint_detail;
+    auto file = std::make_shared<MappedFile>(path, true);
+    const auto* data = file->data();
+    const auto size = file->size();
+    if (size < sizeof(magic) || std::memcmp(data, magic, sizeof(magic)) != 0)
+    {
+        throw std::runtime_error("load_flat_checkpoint: " + path + " is not a flat checkpoint.");
+    }
+
+    std::size_t position = sizeof(magic);
+    const auto count = take<std::uint64_t>(data, size, position);
+    std::map<std::string, Entry> entries;
+    for (std::uint64_t i = 0; i < count; ++i)
+    {
+        Entry entry;
+        const auto name_length = take<std::uint32_t>(data, size, position);
+        if (position + name_length > size)
+        {
+            throw std::runtime_error("load_flat_checkpoint: truncated index.");
+        }
+        entry.name.assign(reinterpret_cast<const char*>(data + position), name_length);
+        position += name_length;
+        const auto dtype = take<std::uint8_t>(data, size, position);
+        if (dtype >= static_cast<std::uint8_t>(torch::ScalarType::NumOptions))
+        {
+            throw std::runtime_error("load_flat_checkpoint: invalid dtype code in " + path + ".");
+        }
+        entry.dtype = static_cast<torch::ScalarType>(dtype);
+        const auto dimensions = take<std::uint8_t>(data, size, position);
+        for (int d = 0; d < dimensions; ++d)
+        {
+            entry.sizes.push_back(take<std::int64_t>(data, size, position));
+        }
+        entry.offset = take<std::uint64_t>(data, size, position);
+        entry.bytes = take<std::uint64_t>(data, size, position);
+        if (entry.offset % data_alignment != 0 || entry.offset > size || entry.bytes > size - entry.offset)
+        {
+            throw std::runtime_error("load_flat_checkpoint: " + entry.name + " lies outside the file or is misaligned.");
+        }
+        entries.emplace(entry.name, std::move(entry));
+    }
+
+    torch::NoGradGuard no_grad;
+    for (auto& item : named_tensors(module))
+    {
+        auto it = entries.find(item.first);
+        if (it == entries.end())
+        {
+            throw std::runtime_error("load_flat_checkpoint: " + path + " has no tensor " + item.first + ".");
+        }
+        const auto& entry = it->second;
+        if (entry.dtype != item.second.scalar_type() || entry.sizes != item.second.sizes().vec())
+        {
+            throw std::runtime_error("load_flat_checkpoint: " + item.first + " has a different dtype or shape in " + path + ".");
+        }
+        // The shape decides how much from_blob reads, so the stored byte count must cover exactly that.
+        if (entry.bytes != static_cast<std::uint64_t>(item.second.numel()) * c10::elementSize(entry.dtype))
+        {
+            throw std::runtime_error("load_flat_checkpoint: " + item.first + " has the wrong byte count in " + path + ".");
+        }
+        auto mapped = torch::from_blob(const_cast<std::uint8_t*>(data) + entry.offset, entry.sizes,
+                                       [file](void*) {}, torch::TensorOptions().dtype(entry.dtype));
+        item.second.set_data(mapped);
+        // Writes to the read-only mapping, such as an optimizer step, would fault.
+        item.second.set_requires_grad(false);
+    }
+}
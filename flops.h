@@ -0,0 +1,28 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <chrono>
+
+// Backward costs about twice the forward pass (gradients with respect to both inputs and weights).
+constexpr double training_step_flops_factor = 3.0;
+
+// Achievable dense float32 matmul throughput of this machine with the current intra-op thread count, as the
+// reference "peak" for reported GFLOP/s. The best of `repetitions` timed runs is used.
+inline double measure_peak_gflops(const int64_t size = 1024, const int repetitions = 5)
+{
+    torch::NoGradGuard no_grad;
+    auto a = torch::rand({size, size});
+    auto b = torch::rand({size, size});
+    auto c = torch::mm(a, b);
+
+    double best_seconds = 0.0;
+    for (int i = 0; i < repetitions; ++i)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        torch::mm_out(c, a, b);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - t0;
+        best_seconds = i == 0 ? elapsed.count() : std::min(best_seconds, elapsed.count());
+    }
+    return 2.0 * static_cast<double>(size) * size * size / best_seconds * 1e-9;
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// One graph of the dataset, in the layout NN::forward consumes.
+struct Graph
+{
+    torch::Tensor edge_index;   // [2, E], int64
+    torch::Tensor node_attr;    // [N, node_attr_size]
+    torch::Tensor edge_attr;    // [E, edge_attr_size]
+    torch::Tensor edge_weight;  // [E, 1]
+    torch::Tensor edge_labels;  // [E, 1]; undefined for unlabelled graphs
+};
+
+inline void validate_graph(const Graph& graph, const std::string& origin)
+{
+    if (!graph.edge_index.defined() || !graph.node_attr.defined() || !graph.edge_attr.defined() || !graph.edge_weight.defined())
+    {
+        throw std::invalid_argument(origin + ": edge_index, node_attr, edge_attr and edge_weight are required.");
+    }
+
+    if (graph.edge_index.dim() != 2 || graph.edge_index.size(0) != 2 || graph.edge_index.scalar_type() != torch::kLong)
+    {
+        throw std::invalid_argument(origin + ": edge_index must be an int64 tensor of shape [2, E].");
+    }
+
+    const auto num_edges = graph.edge_index.size(1);
+    if (graph.node_attr.dim() != 2 || graph.edge_attr.dim() != 2 || graph.edge_attr.size(0) != num_edges
+        || graph.edge_weight.dim() != 2 || graph.edge_weight.size(0) != num_edges)
+    {
+        throw std::invalid_argument(origin + ": node_attr, edge_attr and edge_weight must be matrices with one row per node or edge.");
+    }
+
+    // Out-of-range indices would otherwise only fail inside index_select, deep in a forward pass.
+    if (num_edges > 0)
+    {
+        const auto bounds = graph.edge_index.aminmax();
+        if (std::get<0>(bounds).item<std::int64_t>() < 0 || std::get<1>(bounds).item<std::int64_t>() >= graph.node_attr.size(0))
+        {
+            throw std::invalid_argument(origin + ": edge_index must refer to nodes 0 to N - 1.");
+        }
+    }
+
+    if (graph.edge_labels.defined() && graph.edge_labels.size(0) != num_edges)
+    {
+        throw std::invalid_argument(origin + ": edge_labels must have one row per edge.");
+    }
+}
+
+// Graph files are torch archives holding one tensor per Graph member under the member's name.
+inline void save_graph(const Graph& graph, const std::string& path)
+{
+    torch::serialize::OutputArchive archive;
+    archive.write("edge_index", graph.edge_index);
+    archive.write("node_attr", graph.node_attr);
+    archive.write("edge_attr", graph.edge_attr);
+    archive.write("edge_weight", graph.edge_weight);
+    if (graph.edge_labels.defined())
+    {
+        archive.write("edge_labels", graph.edge_labels);
+    }
+    archive.save_to(path);
+}
+
+inline Graph load_graph(const std::string& path)
+{
+    torch::serialize::InputArchive archive;
+    archive.load_from(path);
+
+    Graph graph;
+    archive.read("edge_index", graph.edge_index);
+    archive.read("node_attr", graph.node_attr);
+    archive.read("edge_attr", graph.edge_attr);
+    archive.read("edge_weight", graph.edge_weight);
+    archive.try_read("edge_labels", graph.edge_labels);
+    validate_graph(graph, "load_graph(" + path + ")");
+    return graph;
+}
+
+// Disjoint union of several graphs. Node and edge offsets have one entry per graph plus a final total, so graph i
+// owns edges [edge_offsets[i], edge_offsets[i + 1]) of the batched graph.
+struct GraphBatch
+{
+    Graph graph;
+    std::vector<std::int64_t> node_offsets;
+    std::vector<std::int64_t> edge_offsets;
+};
+
+inline GraphBatch batch_graphs(const std::vector<Graph>& graphs)
+{
+    if (graphs.empty())
+    {
+        throw std::invalid_argument("batch_graphs: graphs cannot be empty.");
+    }
+
+    GraphBatch batch;
+    batch.node_offsets.push_back(0);
+    batch.edge_offsets.push_back(0);
+
+    std::vector<torch::Tensor> edge_index, node_attr, edge_attr, edge_weight, edge_labels;
+    bool labelled = true;
+    for (const auto& graph : graphs)
+    {
+        edge_index.push_back(graph.edge_index + batch.node_offsets.back());
+        node_attr.push_back(graph.node_attr);
+        edge_attr.push_back(graph.edge_attr);
+        edge_weight.push_back(graph.edge_weight);
+        labelled = labelled && graph.edge_labels.defined();
+        if (labelled)
+        {
+            edge_labels.push_back(graph.edge_labels);
+        }
+        batch.node_offsets.push_back(batch.node_offsets.back() + graph.node_attr.size(0));
+        batch.edge_offsets.push_back(batch.edge_offsets.back() + graph.edge_index.size(1));
+    }
+
+    batch.graph.edge_index = torch::cat(edge_index, 1);
+    batch.graph.node_attr = torch::cat(node_attr, 0);
+    batch.graph.edge_attr = torch::cat(edge_attr, 0);
+    batch.graph.edge_weight = torch::cat(edge_weight, 0);
+    if (labelled)
+    {
+        batch.graph.edge_labels = torch::cat(edge_labels, 0);
+    }
+    return batch;
+}
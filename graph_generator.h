@@ -0,0 +1,211 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <ATen/CPUGeneratorImpl.h>
+#include <yaml-cpp/yaml.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+#include "spatial_graph.h"
+
+// Synthetic graph families for training, benchmarks and scaling studies. Node attributes are uniform in [0, 1)
+// (the first three columns double as positions for "geometric"), edge attributes are source minus target node
+// attributes, labels are uniform and weights are one, as in the trainer's original dataset. Edges point from the
+// higher to the lower node index, except for "knn", whose edges point from each neighbour to its query node.
+struct GraphGeneratorOptions
+{
+    // "erdos_renyi": every node pair independently with edge_probability;
+    // "geometric": nodes within the radius giving mean_degree neighbours in the unit cube;
+    // "knn": every node receives edges from its mean_degree nearest neighbours in the unit cube;
+    // "preferential": Barabasi-Albert attachment of mean_degree / 2 edges per new node.
+    std::string family = "erdos_renyi";
+    double mean_nodes = 30.0;
+    double stddev_nodes = 3.0;
+    double edge_probability = 0.3;
+    // When positive, erdos_renyi uses mean_degree / (N - 1) instead of edge_probability, so the edge count grows
+    // linearly with the node count.
+    double mean_degree = 0.0;
+    int node_attr_size = 3;
+    std::uint64_t seed = 0;
+};
+
+inline GraphGeneratorOptions graph_generator_options(const YAML::Node& config)
+{
+    GraphGeneratorOptions options;
+    options.family = config["family"].as<std::string>(options.family);
+    options.mean_nodes = config["mean_nodes"].as<double>(options.mean_nodes);
+    options.stddev_nodes = config["stddev_nodes"].as<double>(options.stddev_nodes);
+    options.edge_probability = config["edge_probability"].as<double>(options.edge_probability);
+    options.mean_degree = config["mean_degree"].as<double>(options.mean_degree);
+    options.node_attr_size = config["node_attr_size"].as<int>(options.node_attr_size);
+    options.seed = config["seed"].as<std::uint64_t>(options.seed);
+    return options;
+}
+
+class GraphGenerator
+{
+public:
+    explicit GraphGenerator(const GraphGeneratorOptions& options)
+        : generator(at::make_generator<at::CPUGeneratorImpl>(options.seed))
+    {
+        if (options.family != "erdos_renyi" && options.family != "geometric" && options.family != "knn"
+            && options.family != "preferential")
+        {
+            throw std::invalid_argument("GraphGenerator::GraphGenerator: unknown graph family " + options.family + ".");
+        }
+
+        if (options.mean_nodes < 2.0 || options.node_attr_size < 1)
+        {
+            throw std::invalid_argument("GraphGenerator::GraphGenerator: mean_nodes must be at least two and node_attr_size positive.");
+        }
+        this->options = options;
+        size_engine.seed(options.seed);
+    }
+
+    Graph next()
+    {
+        std::normal_distribution<double> size_distribution(options.mean_nodes, options.stddev_nodes);
+        const auto num_nodes = std::max<std::int64_t>(2, std::llround(size_distribution(size_engine)));
+
+        Graph graph;
+        graph.node_attr = torch::rand({num_nodes, options.node_attr_size}, generator);
+        if (options.family == "erdos_renyi")
+        {
+            graph.edge_index = erdos_renyi_edges(num_nodes);
+        }
+        else if (options.family == "geometric")
+        {
+            graph.edge_index = geometric_edges(graph.node_attr);
+        }
+        else if (options.family == "knn")
+        {
+            const double degree = options.mean_degree > 0.0 ? options.mean_degree : options.edge_probability * (num_nodes - 1);
+            graph.edge_index = knn_graph(graph.node_attr.narrow(1, 0, std::min(3, options.node_attr_size)),
+                                         std::max<std::int64_t>(1, std::llround(degree)));
+        }
+        else
+        {
+            graph.edge_index = preferential_edges(num_nodes);
+        }
+
+        const auto num_edges = graph.edge_index.size(1);
+        graph.edge_attr = graph.node_attr.index_select(0, graph.edge_index[0]) - graph.node_attr.index_select(0, graph.edge_index[1]);
+        graph.edge_labels = torch::rand({num_edges, 1}, generator);
+        graph.edge_weight = torch::ones({num_edges, 1});
+        return graph;
+    }
+
+    std::vector<Graph> generate(const int count)
+    {
+        std::vector<Graph> graphs;
+        graphs.reserve(count);
+        for (int i = 0; i < count; ++i)
+        {
+            graphs.push_back(next());
+        }
+        return graphs;
+    }
+
+private:
+    torch::Tensor erdos_renyi_edges(const std::int64_t num_nodes)
+    {
+        const double probability = options.mean_degree > 0.0
+                                   ? std::min(1.0, options.mean_degree / static_cast<double>(num_nodes - 1))
+                                   : options.edge_probability;
+        // The dense mask is exact but quadratic; large graphs draw the expected number of pairs instead and
+        // tolerate the rare duplicate.
+        if (num_nodes <= dense_limit)
+        {
+            torch::Tensor adjacency_matrix = torch::rand({num_nodes, num_nodes}, generator);
+            return torch::argwhere(adjacency_matrix.tril(-1) > 1.0 - probability).transpose(0, 1).contiguous();
+        }
+
+        const auto num_pairs = static_cast<std::int64_t>(std::llround(probability * num_nodes * (num_nodes - 1) / 2.0));
+        auto first = torch::randint(num_nodes, {num_pairs}, generator, torch::kLong);
+        auto second = torch::randint(num_nodes - 1, {num_pairs}, generator, torch::kLong);
+        second = second + (second >= first).to(torch::kLong);
+        return torch::stack({torch::maximum(first, second), torch::minimum(first, second)});
+    }
+
+    torch::Tensor geometric_edges(torch::Tensor node_attr)
+    {
+        const auto num_nodes = node_attr.size(0);
+        const auto dims = std::min<std::int64_t>(3, node_attr.size(1));
+        const double degree = options.mean_degree > 0.0 ? options.mean_degree : options.edge_probability * (num_nodes - 1);
+        // Volume of a ball of the radius times the node count equals the wanted degree (ignoring the boundary).
+        const double pi = 3.14159265358979323846;
+        double radius;
+        if (dims == 3)
+        {
+            radius = std::cbrt(3.0 * degree / (4.0 * pi * num_nodes));
+        }
+        else if (dims == 2)
+        {
+            radius = std::sqrt(degree / (pi * num_nodes));
+        }
+        else
+        {
+            radius = degree / (2.0 * num_nodes);
+        }
+
+        return radius_graph(node_attr.narrow(1, 0, dims), radius);
+    }
+
+    torch::Tensor preferential_edges(const std::int64_t num_nodes)
+    {
+        const double degree = options.mean_degree > 0.0 ? options.mean_degree : options.edge_probability * (num_nodes - 1);
+        const auto edges_per_node = std::max<std::int64_t>(1, std::llround(degree / 2.0));
+
+        // Every edge endpoint is appended to `endpoints`, so a uniform pick from it is proportional to degree.
+        std::vector<std::int64_t> sources;
+        std::vector<std::int64_t> targets;
+        std::vector<std::int64_t> endpoints;
+        std::vector<std::int64_t> picked;
+        for (std::int64_t node = 1; node < num_nodes; ++node)
+        {
+            picked.clear();
+            const auto wanted = std::min(edges_per_node, node);
+            while (static_cast<std::int64_t>(picked.size()) < wanted)
+            {
+                std::int64_t target;
+                if (endpoints.empty() || wanted == node)
+                {
+                    target = static_cast<std::int64_t>(picked.size());
+                }
+                else
+                {
+                    target = endpoints[std::uniform_int_distribution<std::size_t>(0, endpoints.size() - 1)(size_engine)];
+                }
+                if (std::find(picked.begin(), picked.end(), target) == picked.end())
+                {
+                    picked.push_back(target);
+                }
+            }
+            for (auto target : picked)
+            {
+                sources.push_back(node);
+                targets.push_back(target);
+                endpoints.push_back(node);
+                endpoints.push_back(target);
+            }
+        }
+
+        const auto num_edges = static_cast<std::int64_t>(sources.size());
+        auto edge_index = torch::empty({2, num_edges}, torch::kLong);
+        std::copy(sources.begin(), sources.end(), edge_index[0].data_ptr<std::int64_t>());
+        std::copy(targets.begin(), targets.end(), edge_index[1].data_ptr<std::int64_t>());
+        return edge_index;
+    }
+
+    static constexpr std::int64_t dense_limit = 2048;
+
+    GraphGeneratorOptions options;
+    at::Generator generator;
+    std::mt19937_64 size_engine;
+};
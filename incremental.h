@@ -0,0 +1,473 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+struct IncrementalUpdateStats
+{
+    std::vector<std::int64_t> dirty_rows;  // recomputed rows per message passing iteration
+    std::int64_t rescored_edges = 0;
+    bool full_recompute = false;
+};
+
+// Keeps the node states of every message passing iteration of NN for one dynamic graph and, after edges are
+// added or removed or node features change, recomputes only the rows that can differ. A GATConv layer reads
+// one- and two-hop aggregates along both edge directions, so a change at a node dirties its undirected two-hop
+// ball in the next iteration; the readout is rerun only for edges touching the final dirty region.
+// The graph is kept on the CPU; edges are stored in slots that are compacted by swapping with the last one.
+template <typename Model>
+class IncrementalInference
+{
+public:
+    IncrementalInference(Model model, torch::Tensor edge_index, torch::Tensor node_attr,
+                         torch::Tensor edge_attr, torch::Tensor edge_weight,
+                         const double full_recompute_fraction = 0.5)
+        : model(std::move(model))
+    {
+        if (edge_index.dim() != 2 || edge_index.size(0) != 2)
+        {
+            throw std::invalid_argument("IncrementalInference::IncrementalInference: edge_index must have shape [2, E].");
+        }
+
+        if (full_recompute_fraction <= 0.0 || full_recompute_fraction > 1.0)
+        {
+            throw std::invalid_argument("IncrementalInference::IncrementalInference: full_recompute_fraction must be in (0, 1].");
+        }
+
+        this->model->eval();
+        this->full_recompute_fraction = full_recompute_fraction;
+        this->node_attr = node_attr.contiguous().clone();
+        num_nodes = node_attr.size(0);
+        in_edges.resize(num_nodes);
+        out_edges.resize(num_nodes);
+        visited.assign(num_nodes, 0);
+
+        this->edge_attr = torch::empty({0, edge_attr.size(1)}, edge_attr.options());
+        this->edge_weight = torch::empty({0, edge_weight.size(1)}, edge_weight.options());
+        edge_scores = torch::empty({0, 1}, node_attr.options());
+        append_edges(edge_index, edge_attr, edge_weight);
+
+        states.resize(this->model->num_iterations() + 1);
+        states[0] = this->node_attr;
+        recompute_from(0);
+    }
+
+    void add_edges(torch::Tensor edge_index, torch::Tensor edge_attr, torch::Tensor edge_weight)
+    {
+        if (edge_index.dim() != 2 || edge_index.size(0) != 2)
+        {
+            throw std::invalid_argument("IncrementalInference::add_edges: edge_index must have shape [2, E].");
+        }
+
+        const auto first = num_edges;
+        append_edges(edge_index, edge_attr, edge_weight);
+        for (std::int64_t slot = first; slot < num_edges; ++slot)
+        {
+            seeds.push_back(src[slot]);
+            seeds.push_back(dst[slot]);
+        }
+    }
+
+    // Removes one occurrence of every listed edge.
+    void remove_edges(torch::Tensor edge_index)
+    {
+        if (edge_index.dim() != 2 || edge_index.size(0) != 2)
+        {
+            throw std::invalid_argument("IncrementalInference::remove_edges: edge_index must have shape [2, E].");
+        }
+
+        auto edges = edge_index.to(torch::kCPU, torch::kLong).contiguous();
+        auto accessor = edges.accessor<std::int64_t, 2>();
+        for (std::int64_t j = 0; j < edges.size(1); ++j)
+        {
+            const auto source = accessor[0][j];
+            const auto target = accessor[1][j];
+            check_node(source, "remove_edges");
+            check_node(target, "remove_edges");
+
+            const auto& candidates = out_edges[source];
+            auto it = std::find_if(candidates.begin(), candidates.end(),
+                                   [&](std::int64_t slot) { return dst[slot] == target; });
+            if (it == candidates.end())
+            {
+                throw std::invalid_argument("IncrementalInference::remove_edges: edge (" + std::to_string(source) + ", "
+                                            + std::to_string(target) + ") does not exist.");
+            }
+
+            remove_slot(*it);
+            seeds.push_back(source);
+            seeds.push_back(target);
+        }
+    }
+
+    void update_node_attr(torch::Tensor nodes, torch::Tensor new_node_attr)
+    {
+        auto node_index = nodes.to(torch::kCPU, torch::kLong).contiguous();
+        auto accessor = node_index.accessor<std::int64_t, 1>();
+        for (std::int64_t j = 0; j < node_index.size(0); ++j)
+        {
+            check_node(accessor[j], "update_node_attr");
+            seeds.push_back(accessor[j]);
+        }
+        node_attr.index_copy_(0, node_index.to(node_attr.device()), new_node_attr.to(node_attr.options()));
+    }
+
+    // Brings the node states and edge scores up to date with all changes since the previous call.
+    IncrementalUpdateStats refresh()
+    {
+        IncrementalUpdateStats stats;
+        if (seeds.empty())
+        {
+            return stats;
+        }
+
+        torch::NoGradGuard no_grad;
+        std::vector<std::int64_t> dirty = ball(seeds, 0);
+        seeds.clear();
+
+        const int k = model->num_iterations();
+        for (int iteration = 0; iteration < k; ++iteration)
+        {
+            dirty = ball(dirty, 2);
+            if (static_cast<double>(dirty.size()) > full_recompute_fraction * static_cast<double>(num_nodes))
+            {
+                recompute_from(iteration);
+                stats.dirty_rows.resize(k, num_nodes);
+                stats.rescored_edges = num_edges;
+                stats.full_recompute = true;
+                return stats;
+            }
+
+            recompute_rows(iteration, dirty);
+            stats.dirty_rows.push_back(static_cast<std::int64_t>(dirty.size()));
+        }
+
+        auto slots = incident_edges(dirty);
+        rescore(slots);
+        stats.rescored_edges = static_cast<std::int64_t>(slots.size());
+        return stats;
+    }
+
+    torch::Tensor edge_index()
+    {
+        return edge_index_of(0, num_edges);
+    }
+
+    // Attributes and weights of the current edges, in the order of edge_index().
+    torch::Tensor edge_attributes() const
+    {
+        return edge_attr.narrow(0, 0, num_edges);
+    }
+
+    torch::Tensor edge_weights() const
+    {
+        return edge_weight.narrow(0, 0, num_edges);
+    }
+
+    // Scores of the current edges, in the order of edge_index().
+    torch::Tensor scores()
+    {
+        refresh();
+        return edge_scores.narrow(0, 0, num_edges);
+    }
+
+    torch::Tensor output_node_attr()
+    {
+        refresh();
+        return states.back();
+    }
+
+    std::int64_t size() const
+    {
+        return num_edges;
+    }
+
+protected:
+    void check_node(const std::int64_t node, const char* method) const
+    {
+        if (node < 0 || node >= num_nodes)
+        {
+            throw std::out_of_range(std::string("IncrementalInference::") + method + ": node " + std::to_string(node)
+                                    + " is out of range.");
+        }
+    }
+
+    void reserve(const std::int64_t required)
+    {
+        const auto capacity = edge_attr.size(0);
+        if (required <= capacity)
+        {
+            return;
+        }
+
+        const auto new_capacity = std::max<std::int64_t>({required, 2 * capacity, 16});
+        auto grow = [&](torch::Tensor& storage)
+        {
+            auto grown = torch::empty({new_capacity, storage.size(1)}, storage.options());
+            grown.narrow(0, 0, num_edges).copy_(storage.narrow(0, 0, num_edges));
+            storage = grown;
+        };
+        grow(edge_attr);
+        grow(edge_weight);
+        grow(edge_scores);
+    }
+
+    void append_edges(torch::Tensor edge_index, torch::Tensor new_edge_attr, torch::Tensor new_edge_weight)
+    {
+        const auto count = edge_index.size(1);
+        if (new_edge_attr.size(0) != count || new_edge_weight.size(0) != count)
+        {
+            throw std::invalid_argument("IncrementalInference::append_edges: edge_attr and edge_weight must have one row per edge.");
+        }
+
+        auto edges = edge_index.to(torch::kCPU, torch::kLong).contiguous();
+        auto accessor = edges.accessor<std::int64_t, 2>();
+        for (std::int64_t j = 0; j < count; ++j)
+        {
+            check_node(accessor[0][j], "append_edges");
+            check_node(accessor[1][j], "append_edges");
+        }
+
+        reserve(num_edges + count);
+        edge_attr.narrow(0, num_edges, count).copy_(new_edge_attr);
+        edge_weight.narrow(0, num_edges, count).copy_(new_edge_weight);
+        for (std::int64_t j = 0; j < count; ++j)
+        {
+            const auto slot = num_edges + j;
+            src.push_back(accessor[0][j]);
+            dst.push_back(accessor[1][j]);
+            out_edges[accessor[0][j]].push_back(slot);
+            in_edges[accessor[1][j]].push_back(slot);
+        }
+        num_edges += count;
+    }
+
+    static void replace_slot(std::vector<std::int64_t>& slots, const std::int64_t from, const std::int64_t to)
+    {
+        *std::find(slots.begin(), slots.end(), from) = to;
+    }
+
+    static void erase_slot(std::vector<std::int64_t>& slots, const std::int64_t slot)
+    {
+        auto it = std::find(slots.begin(), slots.end(), slot);
+        *it = slots.back();
+        slots.pop_back();
+    }
+
+    void remove_slot(const std::int64_t slot)
+    {
+        erase_slot(out_edges[src[slot]], slot);
+        erase_slot(in_edges[dst[slot]], slot);
+
+        const auto last = num_edges - 1;
+        if (slot != last)
+        {
+            replace_slot(out_edges[src[last]], last, slot);
+            replace_slot(in_edges[dst[last]], last, slot);
+            src[slot] = src[last];
+            dst[slot] = dst[last];
+            edge_attr[slot].copy_(edge_attr[last]);
+            edge_weight[slot].copy_(edge_weight[last]);
+            edge_scores[slot].copy_(edge_scores[last]);
+        }
+
+        src.pop_back();
+        dst.pop_back();
+        --num_edges;
+    }
+
+    // Deduplicated nodes within `hops` undirected hops of `nodes`, starting with the deduplicated input nodes.
+    std::vector<std::int64_t> ball(const std::vector<std::int64_t>& nodes, const int hops)
+    {
+        std::vector<std::int64_t> result;
+        for (auto node : nodes)
+        {
+            if (!visited[node])
+            {
+                visited[node] = 1;
+                result.push_back(node);
+            }
+        }
+
+        std::size_t frontier_begin = 0;
+        for (int hop = 0; hop < hops; ++hop)
+        {
+            const std::size_t frontier_end = result.size();
+            for (std::size_t i = frontier_begin; i < frontier_end; ++i)
+            {
+                const auto node = result[i];
+                for (auto slot : in_edges[node])
+                {
+                    if (!visited[src[slot]])
+                    {
+                        visited[src[slot]] = 1;
+                        result.push_back(src[slot]);
+                    }
+                }
+                for (auto slot : out_edges[node])
+                {
+                    if (!visited[dst[slot]])
+                    {
+                        visited[dst[slot]] = 1;
+                        result.push_back(dst[slot]);
+                    }
+                }
+            }
+            frontier_begin = frontier_end;
+        }
+
+        for (auto node : result)
+        {
+            visited[node] = 0;
+        }
+        return result;
+    }
+
+    std::vector<std::int64_t> incident_edges(const std::vector<std::int64_t>& nodes)
+    {
+        for (auto node : nodes)
+        {
+            visited[node] = 1;
+        }
+
+        std::vector<std::int64_t> slots;
+        for (auto node : nodes)
+        {
+            slots.insert(slots.end(), in_edges[node].begin(), in_edges[node].end());
+            for (auto slot : out_edges[node])
+            {
+                // Edges between two listed nodes were already taken from the in_edges of their target.
+                if (!visited[dst[slot]])
+                {
+                    slots.push_back(slot);
+                }
+            }
+        }
+
+        for (auto node : nodes)
+        {
+            visited[node] = 0;
+        }
+        return slots;
+    }
+
+    torch::Tensor edge_index_of(const std::int64_t first, const std::int64_t count) const
+    {
+        auto sources = torch::tensor(std::vector<std::int64_t>(src.begin() + first, src.begin() + first + count), torch::kLong);
+        auto targets = torch::tensor(std::vector<std::int64_t>(dst.begin() + first, dst.begin() + first + count), torch::kLong);
+        return torch::stack({sources, targets}).to(node_attr.device());
+    }
+
+    void recompute_from(const int first_iteration)
+    {
+        torch::NoGradGuard no_grad;
+        auto full_edge_index = edge_index();
+        auto active_edge_attr = edge_attr.narrow(0, 0, num_edges);
+        auto active_edge_weight = edge_weight.narrow(0, 0, num_edges);
+        for (int iteration = first_iteration; iteration < model->num_iterations(); ++iteration)
+        {
+            states[iteration + 1] = model->iterate(iteration, full_edge_index, states[iteration],
+                                                   active_edge_attr, active_edge_weight, node_attr);
+        }
+
+        if (num_edges > 0)
+        {
+            edge_scores.narrow(0, 0, num_edges).copy_(model->readout(full_edge_index, states.back()));
+        }
+    }
+
+    // Recomputes the given rows of iteration `iteration` on the subgraph of edges incident to their one-hop ball.
+    // That subgraph holds every edge into or out of a one-hop neighbour, so the one-hop aggregates the rows' two-hop
+    // aggregates read are complete; the extra boundary nodes get wrong values but are discarded.
+    void recompute_rows(const int iteration, const std::vector<std::int64_t>& rows)
+    {
+        auto halo = ball(rows, 1);
+        auto slots = incident_edges(halo);
+
+        std::unordered_map<std::int64_t, std::int64_t> local_id;
+        local_id.reserve(2 * halo.size());
+        std::vector<std::int64_t> nodes = halo;
+        for (std::size_t i = 0; i < halo.size(); ++i)
+        {
+            local_id.emplace(halo[i], static_cast<std::int64_t>(i));
+        }
+
+        auto local = [&](const std::int64_t node)
+        {
+            auto inserted = local_id.emplace(node, static_cast<std::int64_t>(nodes.size()));
+            if (inserted.second)
+            {
+                nodes.push_back(node);
+            }
+            return inserted.first->second;
+        };
+
+        std::vector<std::int64_t> local_src(slots.size());
+        std::vector<std::int64_t> local_dst(slots.size());
+        for (std::size_t j = 0; j < slots.size(); ++j)
+        {
+            local_src[j] = local(src[slots[j]]);
+            local_dst[j] = local(dst[slots[j]]);
+        }
+
+        const auto device = node_attr.device();
+        auto local_edge_index = torch::stack({torch::tensor(local_src, torch::kLong),
+                                              torch::tensor(local_dst, torch::kLong)}).to(device);
+        auto slot_index = torch::tensor(slots, torch::kLong).to(device);
+        auto node_index = torch::tensor(nodes, torch::kLong).to(device);
+
+        auto output = model->iterate(iteration, local_edge_index,
+                                     states[iteration].index_select(0, node_index),
+                                     edge_attr.index_select(0, slot_index),
+                                     edge_weight.index_select(0, slot_index),
+                                     node_attr.index_select(0, node_index));
+
+        // ball() lists the input rows first, so they are the first local ids.
+        const auto row_count = static_cast<std::int64_t>(rows.size());
+        states[iteration + 1].index_copy_(0, node_index.narrow(0, 0, row_count), output.narrow(0, 0, row_count));
+    }
+
+    void rescore(const std::vector<std::int64_t>& slots)
+    {
+        if (slots.empty())
+        {
+            return;
+        }
+
+        std::vector<std::int64_t> sources(slots.size());
+        std::vector<std::int64_t> targets(slots.size());
+        for (std::size_t j = 0; j < slots.size(); ++j)
+        {
+            sources[j] = src[slots[j]];
+            targets[j] = dst[slots[j]];
+        }
+
+        const auto device = node_attr.device();
+        auto query_edge_index = torch::stack({torch::tensor(sources, torch::kLong),
+                                              torch::tensor(targets, torch::kLong)}).to(device);
+        auto slot_index = torch::tensor(slots, torch::kLong).to(device);
+        edge_scores.index_copy_(0, slot_index, model->readout(query_edge_index, states.back()));
+    }
+
+    Model model;
+    double full_recompute_fraction;
+    std::int64_t num_nodes = 0;
+    std::int64_t num_edges = 0;
+    torch::Tensor node_attr;
+    torch::Tensor edge_attr;
+    torch::Tensor edge_weight;
+    torch::Tensor edge_scores;
+    std::vector<std::int64_t> src;
+    std::vector<std::int64_t> dst;
+    std::vector<std::vector<std::int64_t>> in_edges;
+    std::vector<std::vector<std::int64_t>> out_edges;
+    std::vector<char> visited;
+    std::vector<std::int64_t> seeds;
+    std::vector<torch::Tensor> states;  // states[0] is node_attr, states[i + 1] the output of iteration i
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "cost_model.h"
+#include "embedding_cache.h"
+
+// Serving front end for NN: scores query edges on a graph, reusing the node embeddings of graphs that were
+// already seen. A graph is identified by graph_id; callers bump version whenever its structure or features change.
+template <typename Model>
+class InferenceEngine
+{
+public:
+    using AnytimeResult = typename Model::Impl::AnytimeResult;
+
+    InferenceEngine(Model model, const std::size_t cache_budget_bytes)
+        : model(std::move(model)), cache(cache_budget_bytes)
+    {
+        this->model->eval();
+    }
+
+    torch::Tensor score(const std::int64_t graph_id, const std::int64_t version,
+                        torch::Tensor edge_index, torch::Tensor node_attr,
+                        torch::Tensor edge_attr, torch::Tensor edge_weight,
+                        torch::Tensor query_edge_index)
+    {
+        torch::NoGradGuard no_grad;
+        return model->readout(query_edge_index, embed(graph_id, version, edge_index, node_attr, edge_attr, edge_weight));
+    }
+
+    torch::Tensor embed(const std::int64_t graph_id, const std::int64_t version,
+                        torch::Tensor edge_index, torch::Tensor node_attr,
+                        torch::Tensor edge_attr, torch::Tensor edge_weight)
+    {
+        torch::NoGradGuard no_grad;
+        if (auto cached = cache.get(graph_id, version))
+        {
+            return *cached;
+        }
+
+        auto output_node_attr = model->embed(edge_index, node_attr, edge_attr, edge_weight);
+        cache.put(graph_id, version, output_node_attr);
+        return output_node_attr;
+    }
+
+    // Deadline-aware variant of score(). Cached embeddings are always complete; on a miss the embedding runs
+    // as many iterations as the cost model allows and is cached only if all of them completed.
+    AnytimeResult score(const std::int64_t graph_id, const std::int64_t version,
+                        torch::Tensor edge_index, torch::Tensor node_attr,
+                        torch::Tensor edge_attr, torch::Tensor edge_weight,
+                        torch::Tensor query_edge_index,
+                        const std::chrono::steady_clock::time_point deadline)
+    {
+        if (!cost_model.is_calibrated())
+        {
+            throw std::logic_error("InferenceEngine::score: calibrate() must be called before scoring with a deadline.");
+        }
+
+        torch::NoGradGuard no_grad;
+        if (auto cached = cache.get(graph_id, version))
+        {
+            return AnytimeResult{model->readout(query_edge_index, *cached), model->num_iterations()};
+        }
+
+        auto embedding = model->embed_until(edge_index, node_attr, edge_attr, edge_weight,
+                                            deadline, cost_model, query_edge_index.size(1));
+        if (embedding.iterations == model->num_iterations())
+        {
+            cache.put(graph_id, version, embedding.output);
+        }
+        return AnytimeResult{model->readout(query_edge_index, embedding.output), embedding.iterations};
+    }
+
+    // Builds the per-iteration cost model used by deadline-aware scoring from warmup runs on representative graphs.
+    void calibrate(const std::vector<torch::Tensor>& edge_index,
+                   const std::vector<torch::Tensor>& node_attr,
+                   const std::vector<torch::Tensor>& edge_attr,
+                   const std::vector<torch::Tensor>& edge_weight,
+                   const int repetitions = 3)
+    {
+        cost_model.calibrate(model, edge_index, node_attr, edge_attr, edge_weight, repetitions);
+    }
+
+    void invalidate(const std::int64_t graph_id)
+    {
+        cache.invalidate(graph_id);
+    }
+
+    EmbeddingCacheStats cache_stats() const
+    {
+        return cache.stats();
+    }
+
+protected:
+    Model model;
+    EmbeddingCache cache;
+    IterationCostModel cost_model;
+};
@@ -5,387 +5,367 @@
 #include <string>
 #include <chrono>
 #include <vector>
-#include <random>
-#include <cmath>
+#include <algorithm>
+#include <future>
+#include <thread>
+#include <filesystem>
+#include <cstdio>
+#include <memory>
+
+#include "nn.h"
+#include "graph.h"
+#include "graph_generator.h"
+#include "packed_dataset.h"
+#include "npy_loader.h"
+#include "model_config.h"
+#include "activation_compression.h"
+#include "flat_checkpoint.h"
+#include "inference.h"
+#include "planned_inference.h"
+#include "incremental.h"
+#include "adaptive_executor.h"
+#include "sinks.h"
+#include "root_plugin.h"
+#include "process_stats.h"
+#include "metrics_registry.h"
+#include "flops.h"
+#include "perf_counters.h"
 
-#include "TH1D.h"
-#include "TRandom3.h"
-
-#include "TROOT.h"
-#include "TObject.h"
-#include "TSystem.h"
-#include "TDirectory.h"
-#include "TFile.h"
-#include "TCanvas.h"
-#include "TColor.h"
-#include "TPad.h"
-#include "TGraph.h"
-#include "TMultiGraph.h"
-#include "TGraph2D.h"
-#include "TPolyLine3D.h"
-#include "TStyle.h"
-#include "TLatex.h"
-#include "TLegend.h"
-#include "TString.h"
-
-void rootplot(const float* x, const float* y, const int size, const std::string& output_filename)
+int main()
 {
-    TFile* fout = 0;
-    fout = new TFile(output_filename.c_str(), "update");
-    TString topdir = gDirectory->GetPath();
-    TCanvas* can = new TCanvas("Training_dynamics", "Training_dynamics", 0, 0, 700, 500);
-    TGraph* graph = new TGraph(size);
-    for (int i = 0; i < size; ++i)
+    auto start = std::chrono::steady_clock::now();
+    
+    YAML::Node config = YAML::LoadFile("../configs/training_parameters.yaml");
+    int num_epochs = config["num_epochs"].as<int>();
+    float lr = config["lr"].as<float>();
+
+    // Memory-mapped from a packed .npz archive if one is configured, otherwise generated once and packed into a
+    // few contiguous buffers; dataset.graph(i) returns views into them.
+    YAML::Node dataset_config = config["dataset"];
+    PackedGraphDataset dataset;
+    const auto dataset_npz = dataset_config["npz"].as<std::string>("");
+    if (!dataset_npz.empty())
     {
-        graph->SetPoint(i, x[i], y[i]);
+        dataset = load_npz_dataset(dataset_npz);
     }
-    graph->GetXaxis()->SetTitle("Epoch number");
-    graph->GetYaxis()->SetTitle("Loss");
-    graph->Draw("AL");
-    gDirectory->cd(topdir);
-    can->Write("abc", TObject::kWriteDelete, 0);
-    can = nullptr;
-    fout->Close();
-    fout = nullptr;
-}
-
-template <typename ActivationType = torch::nn::Tanh,
-typename EndActivationType = torch::nn::Identity>
-class MLPImpl final : public torch::nn::Module
-{
-public:
-    MLPImpl(const int input_size,
-            const std::vector<int>& hidden_sizes,
-            const int output_size,
-            const double dropout_prob = 0.0,
-            const bool use_layer_norm = true)
+    else
     {
-        if (input_size < 1)
-        {
-            throw std::invalid_argument("MLPImpl::MLPImpl: input_size cannot be less than one.");
-        }
-
-        if (output_size < 1)
-        {
-            throw std::invalid_argument("MLPImpl::MLPImpl: output_size cannot be less than one.");
-        }
-
-        if(hidden_sizes.empty())
-        {
-            throw std::invalid_argument("MLPImpl::MLPImpl: hidden_sizes cannot be empty.");
-        }
+        auto generator_options = graph_generator_options(dataset_config);
+        generator_options.node_attr_size = config["node_attr_size"].as<int>(3);
+        dataset = PackedGraphDataset::pack(GraphGenerator(generator_options).generate(dataset_config["num_graphs"].as<int>(100)));
+    }
+    const int num_graphs = static_cast<int>(dataset.size());
 
-        for(auto& it : hidden_sizes)
-        {
-            if (it < 1)
-            {
-                throw std::invalid_argument("MLPImpl::MLPImpl: All components of hidden_sizes must be greater than zero.");
-            }
-        }
+    auto model = make_model(config);
+    torch::optim::Adam opt(model->parameters(), lr);
+    torch::nn::MSELoss loss_fn;
+    torch::nn::L1Loss metric_fn;
+    std::chrono::duration<double> startup_time = std::chrono::steady_clock::now() - start;
+    std::cout << "Startup time (to first training step): " << startup_time.count() << " s; RSS: " << resident_set_size_bytes() / (1024.0 * 1024.0) << " MB.\n";
 
-        model = register_module("model", torch::nn::Sequential());
+    // ROOT is loaded only if metrics are written.
+    std::unique_ptr<MetricsSink> metrics;
+    auto metrics_output = config["metrics_output"].as<std::string>("");
+    if (!metrics_output.empty())
+    {
+        metrics = RootPlugin::instance().make_metrics_sink(metrics_output, std::chrono::seconds(config["metrics_autosave_s"].as<int>(10)));
+    }
+    MetricsRegistry registry;
+    auto& steps_total = registry.counter("train_steps_total", "Optimizer steps taken.");
+    auto& graphs_total = registry.counter("train_graphs_total", "Graphs processed.");
+    auto& nodes_total = registry.counter("train_nodes_total", "Nodes processed.");
+    auto& edges_total = registry.counter("train_edges_total", "Edges processed.");
+    auto& flops_total = registry.counter("train_flops_total", "Estimated floating point operations of all steps.");
+    auto& step_latency = registry.histogram("train_step_seconds", "Wall time of one training step.",
+                                            Histogram::exponential_bounds(1e-4, 2.0, 16));
+    auto& graphs_per_second = registry.gauge("train_graphs_per_second", "Graph throughput of the last step.");
+    auto& edges_per_second = registry.gauge("train_edges_per_second", "Edge throughput of the last step.");
+    auto& step_loss_gauge = registry.gauge("train_loss", "Loss of the last step.");
+    auto& epoch_gauge = registry.gauge("train_epoch", "Current epoch.");
+    auto& rss_gauge = registry.gauge("process_resident_memory_bytes", "Resident set size, sampled once per epoch.");
+    std::unique_ptr<PrometheusFileExporter> prometheus_exporter;
+    auto prometheus_output = config["prometheus_output"].as<std::string>("");
+    if (!prometheus_output.empty())
+    {
+        prometheus_exporter = std::make_unique<PrometheusFileExporter>(registry, prometheus_output,
+                                                                       std::chrono::seconds(config["prometheus_interval_s"].as<int>(15)));
+    }
 
-        model->push_back(torch::nn::Linear(input_size, hidden_sizes[0]));
+    const double peak_gflops = measure_peak_gflops();
+    std::cout << "Measured matmul peak: " << peak_gflops << " GFLOP/s.\n";
 
-        if (use_layer_norm)
-        {
-            model->push_back(torch::nn::LayerNorm(torch::nn::LayerNormOptions({hidden_sizes[0]})));
-        }
+    // Enabled after the peak measurement has started the intra-op pool, so its threads are counted too.
+    if (config["perf_counters"].as<bool>(false))
+    {
+        auto& counters = PerfCounters::instance();
+        counters.enable();
+        std::cout << "Hardware counters: " << counters.status_message() << '\n';
+    }
 
-        model->push_back(ActivationType());
+    // Memory the configured activation storage saves on the first graph, and what it costs in gradient accuracy.
+    if (config["activation_storage_report"].as<bool>(false) && num_graphs > 0)
+    {
+        const auto graph = dataset.graph(0);
+        const auto report = compare_activation_storage(model, model->get_activation_storage(), loss_fn, graph.edge_index,
+                                                       graph.node_attr, graph.edge_attr, graph.edge_weight, graph.edge_labels);
+        std::cout << "Activation storage: " << report.saved_bytes_configured / (1024.0 * 1024.0) << " MB kept for backward instead of "
+                  << report.saved_bytes_none / (1024.0 * 1024.0) << " MB; relative gradient error "
+                  << report.gradient_error << ".\n";
+    }
 
-        if (dropout_prob > 0.0)
-        {
-            model->push_back(torch::nn::Dropout(dropout_prob));
-        }
+    // gatconv1's propagation of the fixed graph inputs, computed on first use and reused in every later epoch.
+    const bool cache_input_aggregates = config["cache_input_aggregates"].as<bool>(true);
+    std::vector<torch::Tensor> input_aggregates(cache_input_aggregates ? num_graphs : 0);
 
-        for (size_t i = 1; i < hidden_sizes.size(); ++i)
+    std::int64_t step = 0;
+    for (int epoch = 0; epoch < num_epochs; ++epoch)
+    {
+        auto epoch_start = std::chrono::steady_clock::now();
+        epoch_gauge.set(epoch);
+        rss_gauge.set(static_cast<double>(resident_set_size_bytes()));
+        float epoch_loss = 0;
+        float epoch_metric = 0;
+        std::int64_t epoch_nodes = 0;
+        std::int64_t epoch_edges = 0;
+        double epoch_flops = 0.0;
+        for (int i = 0; i < num_graphs; ++i)
         {
-            model->push_back(torch::nn::Linear(hidden_sizes[i-1], hidden_sizes[i]));
-
-            if (use_layer_norm)
+            auto step_start = std::chrono::steady_clock::now();
+            const auto graph = dataset.graph(i);
+            torch::Tensor pred;
+            if (cache_input_aggregates)
             {
-                model->push_back(torch::nn::LayerNorm(torch::nn::LayerNormOptions({hidden_sizes[i]})));
+                if (!input_aggregates[i].defined())
+                {
+                    input_aggregates[i] = model->input_aggregates(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight);
+                }
+                pred = model->forward(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight, input_aggregates[i]);
             }
-
-            model->push_back(ActivationType());
-
-            if (dropout_prob > 0.0)
+            else
             {
-                model->push_back(torch::nn::Dropout(dropout_prob));
+                pred = model->forward(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight);
             }
+            torch::Tensor loss = loss_fn(pred, graph.edge_labels);
+            torch::Tensor metric = metric_fn(pred, graph.edge_labels);
+            loss.backward();
+            {
+                PerfScope scope(PerfRegion::optimizer);
+                opt.step();
+            }
+            opt.zero_grad();
+            float step_loss = loss.item<float>();
+            float step_metric = metric.item<float>();
+            epoch_loss += step_loss;
+            epoch_metric += step_metric;
+            std::chrono::duration<double> step_time = std::chrono::steady_clock::now() - step_start;
+            const auto num_nodes = dataset.num_nodes(i);
+            const auto num_edges = dataset.num_edges(i);
+            const double step_flops = training_step_flops_factor * model->estimate_flops(num_nodes, num_edges, cache_input_aggregates);
+            epoch_nodes += num_nodes;
+            epoch_edges += num_edges;
+            epoch_flops += step_flops;
+            steps_total.increment();
+            graphs_total.increment();
+            nodes_total.increment(static_cast<double>(num_nodes));
+            edges_total.increment(static_cast<double>(num_edges));
+            flops_total.increment(step_flops);
+            step_latency.observe(step_time.count());
+            graphs_per_second.set(1.0 / step_time.count());
+            edges_per_second.set(num_edges / step_time.count());
+            step_loss_gauge.set(step_loss);
+            if (metrics)
+            {
+                metrics->record({MetricsRecord::step, epoch, step, step_loss, step_metric, lr, step_time.count(), 1.0 / step_time.count()});
+            }
+            ++step;
         }
-
-        model->push_back(torch::nn::Linear(hidden_sizes.back(), output_size));
-
-        if constexpr(!std::is_same_v<EndActivationType, torch::nn::Identity>)
+        std::chrono::duration<double> epoch_time = std::chrono::steady_clock::now() - epoch_start;
+        const double epoch_gflops = epoch_flops / epoch_time.count() * 1e-9;
+        std::cout << "epoch:\t" << epoch << ";\tloss:\t" << epoch_loss / num_graphs << ";\tmetric:\t" << epoch_metric / num_graphs
+                  << ";\tgraphs/s:\t" << num_graphs / epoch_time.count() << ";\tnodes/s:\t" << epoch_nodes / epoch_time.count()
+                  << ";\tedges/s:\t" << epoch_edges / epoch_time.count() << ";\tGFLOP/s:\t" << epoch_gflops
+                  << " (" << 100.0 * epoch_gflops / peak_gflops << " % of peak)" << '\n';
+        PerfCounters::instance().report(std::cout, "epoch:\t" + std::to_string(epoch));
+        PerfCounters::instance().reset();
+        if (metrics)
         {
-            model->push_back(EndActivationType());
+            metrics->record({MetricsRecord::epoch, epoch, step, epoch_loss / num_graphs, epoch_metric / num_graphs, lr, epoch_time.count(), num_graphs / epoch_time.count()});
         }
     }
-
-    ~MLPImpl() override = default;
-
-    torch::Tensor forward(torch::Tensor x)
-    {
-        return model->forward(x);
-    }
-
-private:
-    torch::nn::Sequential model{nullptr};
-};
-
-template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
-class MLP : public torch::nn::ModuleHolder<MLPImpl<ActivationType, EndActivationType>>
-{
-public:
-    using torch::nn::ModuleHolder<MLPImpl<ActivationType, EndActivationType>>::ModuleHolder;
-    using Impl TORCH_UNUSED_EXCEPT_CUDA = MLPImpl<ActivationType, EndActivationType>;
-};
-
-template <typename ActivationType = torch::nn::Tanh,
-typename EndActivationType = torch::nn::Identity>
-class GATConvImpl : public torch::nn::Module
-{
-public:
-    GATConvImpl(const int input_node_attr_size,
-                const std::vector<int>& hidden_sizes,
-                const int output_node_attr_size,
-                const int initial_node_attr_size,
-                const int edge_attr_size,
-                const double dropout_prob = 0.0,
-                const bool use_layer_norm = true)
+    if (metrics)
     {
-        if (input_node_attr_size < 1)
-        {
-            throw std::invalid_argument("GATConvImpl::GATConvImpl: input_node_attr_size cannot be less than one.");
-        }
-
-        if (output_node_attr_size < 1)
+        metrics->close();
+        if (metrics->dropped() > 0)
         {
-            throw std::invalid_argument("GATConvImpl::GATConvImpl: output_node_attr_size cannot be less than one.");
+            std::cout << "Metrics records dropped: " << metrics->dropped() << '\n';
         }
+    }
 
-        if (initial_node_attr_size < 1)
-        {
-            throw std::invalid_argument("GATConvImpl::GATConvImpl: initial_node_attr_size cannot be less than one.");
-        }
+    prometheus_exporter.reset();
 
-        if (edge_attr_size < 1)
-        {
-            throw std::invalid_argument("GATConvImpl::GATConvImpl: edge_attr_size cannot be less than one.");
-        }
+    torch::save(model, config["model_output"].as<std::string>("model.pt"));
+    const auto flat_model_output = config["flat_model_output"].as<std::string>("");
+    if (!flat_model_output.empty())
+    {
+        save_flat_checkpoint(*model, flat_model_output);
+    }
 
-        if(hidden_sizes.empty())
+    // Optionally export the generated graphs in the format read by the batch scorer.
+    auto dataset_output_dir = config["dataset_output_dir"].as<std::string>("");
+    if (!dataset_output_dir.empty())
+    {
+        std::filesystem::create_directories(dataset_output_dir);
+        for (int i = 0; i < num_graphs; ++i)
         {
-            throw std::invalid_argument("GATConvImpl::GATConvImpl: hidden_sizes cannot be empty.");
+            char filename[32];
+            std::snprintf(filename, sizeof(filename), "graph_%05d.pt", i);
+            save_graph(dataset.graph(i), (std::filesystem::path(dataset_output_dir) / filename).string());
         }
+    }
 
-        for(auto& it : hidden_sizes)
+    // Score every graph twice through the serving path: the second pass is served from the embedding cache.
+    InferenceEngine engine(model, config["inference_cache_mb"].as<std::size_t>(64) * 1024 * 1024);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int i = 0; i < num_graphs; ++i)
         {
-            if (it < 1)
-            {
-                throw std::invalid_argument("GATConvImpl::GATConvImpl: All components of hidden_sizes must be greater than zero.");
-            }
+            const auto graph = dataset.graph(i);
+            engine.score(i, 0, graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight, graph.edge_index);
         }
-
-        mlp = register_module("mlp", MLP<ActivationType, EndActivationType>(5 * input_node_attr_size + initial_node_attr_size + 4 * edge_attr_size,
-                                                                            hidden_sizes,
-                                                                            output_node_attr_size,
-                                                                            dropout_prob,
-                                                                            use_layer_norm));
     }
-
-    virtual ~GATConvImpl() override = default;
-
-    virtual torch::Tensor forward(torch::Tensor edge_index, torch::Tensor node_attr,
-                                  torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor initial_node_attr)
+    auto cache_stats = engine.cache_stats();
+    std::cout << "Embedding cache hit rate: " << cache_stats.hit_rate() << "; memory: " << cache_stats.memory_bytes
+              << " / " << cache_stats.memory_budget_bytes << " B in " << cache_stats.entries << " entries.\n";
+
+    // Deadline-bound scoring of updated graphs (version 1), which misses the cache.
+    const int num_calibration_graphs = 10;
+    std::vector<torch::Tensor> calibration_edge_index, calibration_node_features, calibration_edge_features, calibration_edge_weights;
+    for (int i = 0; i < std::min(num_calibration_graphs, num_graphs); ++i)
     {
-        auto reversed_edge_index = edge_index.flip(0);
-
-        auto one_hop_incoming = propagate(edge_index, node_attr, edge_attr, edge_weight, 1);
-        auto one_hop_outgoing = propagate(reversed_edge_index, node_attr, edge_attr, edge_weight, 1);
-
-        auto two_hop_incoming = propagate(edge_index, one_hop_incoming, edge_attr, edge_weight, 2);
-        auto two_hop_outgoing = propagate(reversed_edge_index, one_hop_outgoing, edge_attr, edge_weight, 2);
-
-        auto combined = torch::cat({initial_node_attr, node_attr,
-            one_hop_incoming, one_hop_outgoing,
-            two_hop_incoming, two_hop_outgoing}, -1);
-
-        return mlp->forward(combined);
+        const auto graph = dataset.graph(i);
+        calibration_edge_index.push_back(graph.edge_index);
+        calibration_node_features.push_back(graph.node_attr);
+        calibration_edge_features.push_back(graph.edge_attr);
+        calibration_edge_weights.push_back(graph.edge_weight);
     }
-
-protected:
-    virtual torch::Tensor propagate(torch::Tensor edge_index, torch::Tensor node_attr,
-                                    torch::Tensor edge_attr, torch::Tensor edge_weight, int hop)
+    if (config["inference_deadline_demo"].as<bool>(false))
     {
-        auto messages = message(edge_index, node_attr, edge_attr, edge_weight, hop);
-
-        return aggregate(edge_index, messages, node_attr.size(0));
+        engine.calibrate(calibration_edge_index, calibration_node_features, calibration_edge_features, calibration_edge_weights);
+        const std::chrono::duration<double, std::milli> deadline_budget(config["inference_deadline_ms"].as<double>(1.0));
+        int total_iterations = 0;
+        for (int i = 0; i < num_graphs; ++i)
+        {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(deadline_budget);
+            const auto graph = dataset.graph(i);
+            total_iterations += engine.score(i, 1, graph.edge_index, graph.node_attr, graph.edge_attr,
+                                             graph.edge_weight, graph.edge_index, deadline).iterations;
+        }
+        std::cout << "Mean iterations within " << deadline_budget.count() << " ms deadline: " << total_iterations / static_cast<double>(num_graphs) << '\n';
     }
 
-    virtual torch::Tensor message(torch::Tensor edge_index, torch::Tensor node_attr,
-                                  torch::Tensor edge_attr, torch::Tensor edge_weight, int hop)
+    // Asynchronous scoring with per-request intra-op parallelism (version 2 misses the cache again).
+    // Narrow workers and the wide team get disjoint cores: by default half of them each.
+    if (config["inference_executor_demo"].as<bool>(false))
     {
-        auto source_nodes = edge_index[0];
-        auto node_attr_j = node_attr.index_select(0, source_nodes);
-
-        if(hop == 1)
+        const int num_cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        int num_workers = config["inference_workers"].as<int>(0);
+        if (num_workers < 1)
         {
-            return edge_weight * torch::cat({node_attr_j, edge_attr}, -1);
+            num_workers = std::max(1, num_cores - num_cores / 2);
         }
-        else
+        ParallelismPolicy policy(std::max(1, std::min(at::get_num_threads(), num_cores - num_workers)));
+        policy.calibrate(model, calibration_edge_index, calibration_node_features, calibration_edge_features, calibration_edge_weights);
+        auto executor_start = std::chrono::steady_clock::now();
+        AdaptiveInferenceExecutor executor(engine, policy, num_workers);
+        std::vector<std::future<torch::Tensor>> results;
+        for (int i = 0; i < num_graphs; ++i)
         {
-            return edge_weight * node_attr_j;
+            const auto graph = dataset.graph(i);
+            results.push_back(executor.submit({i, 2, graph.edge_index, graph.node_attr, graph.edge_attr,
+                                               graph.edge_weight, graph.edge_index}));
         }
+        for (auto& result : results)
+        {
+            result.get();
+        }
+        std::chrono::duration<double> executor_elapsed = std::chrono::steady_clock::now() - executor_start;
+        auto executor_stats = executor.stats();
+        std::cout << "Adaptive executor: " << executor_stats.narrow_requests << " narrow, " << executor_stats.wide_requests
+                  << " wide requests; " << num_graphs / executor_elapsed.count() << " graphs/s.\n";
     }
 
-    virtual torch::Tensor aggregate(torch::Tensor edge_index, torch::Tensor messages, int num_nodes)
+    // Events on a fixed graph structure: the first graph's topology with noisy attributes, scored one by one and
+    // as one topology-shared batch.
+    const int shared_batch_size = config["shared_topology_batch"].as<int>(0);
+    if (shared_batch_size > 0)
     {
-        auto target_nodes = edge_index[1];
+        torch::NoGradGuard no_grad;
+        const auto graph = dataset.graph(0);
+        auto topology = make_shared_topology(graph.edge_index, graph.edge_weight, graph.node_attr.size(0));
+        auto event_node_attr = graph.node_attr.unsqueeze(0) + 0.1 * torch::randn({shared_batch_size, graph.node_attr.size(0), graph.node_attr.size(1)});
+        auto event_edge_attr = graph.edge_attr.unsqueeze(0) + 0.1 * torch::randn({shared_batch_size, graph.edge_attr.size(0), graph.edge_attr.size(1)});
+
+        auto loop_start = std::chrono::steady_clock::now();
+        for (int b = 0; b < shared_batch_size; ++b)
+        {
+            model->forward(graph.edge_index, event_node_attr[b], event_edge_attr[b], graph.edge_weight);
+        }
+        std::chrono::duration<double> loop_elapsed = std::chrono::steady_clock::now() - loop_start;
 
-        return torch::zeros({num_nodes, messages.size(1)}, messages.options()).index_add_(0, target_nodes, messages);
+        auto shared_start = std::chrono::steady_clock::now();
+        model->forward_shared(topology, event_node_attr, event_edge_attr);
+        std::chrono::duration<double> shared_elapsed = std::chrono::steady_clock::now() - shared_start;
+        std::cout << "Shared topology: " << shared_batch_size / loop_elapsed.count() << " events/s one by one, "
+                  << shared_batch_size / shared_elapsed.count() << " events/s batched.\n";
     }
 
-    MLP<ActivationType, EndActivationType> mlp{nullptr};
-};
-
-template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
-class GATConv : public torch::nn::ModuleHolder<GATConvImpl<ActivationType, EndActivationType>>
-{
-public:
-    using torch::nn::ModuleHolder<GATConvImpl<ActivationType, EndActivationType>>::ModuleHolder;
-    using Impl TORCH_UNUSED_EXCEPT_CUDA = GATConvImpl<ActivationType, EndActivationType>;
-};
-
-template <typename ActivationType = torch::nn::Tanh,
-typename EndActivationType = torch::nn::Identity>
-class NNImpl : public torch::nn::Module
-{
-public:
-    NNImpl(const int node_attr_size,
-           const std::vector<int>& hidden_sizes_1,
-           const std::vector<int>& hidden_sizes_2,
-           const std::vector<int>& hidden_sizes_mlp,
-           const int output_node_attr_size,
-           const int edge_attr_size,
-           const double dropout_prob = 0.0,
-           const bool use_layer_norm = true,
-           const int k = 6)
+    // Edge updates on the first graph: the incremental refresh against a full forward pass over the edited graph.
+    if (config["incremental_inference"].as<bool>(false) && num_graphs > 0)
     {
-        gatconv1 = register_module("gatconv1", GATConv<ActivationType, EndActivationType>(node_attr_size,
-                                                                                          hidden_sizes_1,
-                                                                                          output_node_attr_size,
-                                                                                          node_attr_size,
-                                                                                          edge_attr_size,
-                                                                                          dropout_prob,
-                                                                                          use_layer_norm));
-        gatconv2 = register_module("gatconv2", GATConv<ActivationType, EndActivationType>(output_node_attr_size,
-                                                                                          hidden_sizes_2,
-                                                                                          output_node_attr_size,
-                                                                                          node_attr_size,
-                                                                                          edge_attr_size,
-                                                                                          dropout_prob,
-                                                                                          use_layer_norm));
-        mlp = register_module("mlp", MLP<ActivationType, EndActivationType>(2 * output_node_attr_size,
-                                                                            hidden_sizes_mlp,
-                                                                            1,
-                                                                            dropout_prob,
-                                                                            use_layer_norm));
-        this->k = k;
-    }
-    virtual ~NNImpl() override = default;
-    virtual torch::Tensor forward(torch::Tensor edge_index, torch::Tensor node_attr,
-                                  torch::Tensor edge_attr, torch::Tensor edge_weight)
-    {
-        torch::Tensor output_node_attr = gatconv1->forward(edge_index, node_attr, edge_attr, edge_weight, node_attr);
-        for (int i = 0; i < k - 1; ++i)
+        torch::NoGradGuard no_grad;
+        const auto graph = dataset.graph(0);
+        IncrementalInference incremental(model, graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight);
+        const auto num_removed = std::min<std::int64_t>(4, graph.edge_index.size(1));
+        incremental.remove_edges(graph.edge_index.narrow(1, 0, num_removed));
+        auto added = torch::randint(graph.node_attr.size(0), {2, 4}, torch::kLong);
+        incremental.add_edges(added, torch::rand({4, graph.edge_attr.size(1)}), torch::ones({4, graph.edge_weight.size(1)}));
+        const auto update = incremental.refresh();
+
+        auto full = model->forward(incremental.edge_index(), graph.node_attr, incremental.edge_attributes(), incremental.edge_weights());
+        const auto difference = (incremental.scores() - full).abs().max().item<double>();
+        std::int64_t dirty_rows = 0;
+        for (const auto rows : update.dirty_rows)
         {
-            output_node_attr = gatconv2->forward(edge_index, output_node_attr, edge_attr, edge_weight, node_attr);
+            dirty_rows += rows;
         }
-        auto source_nodes = edge_index[0];
-        auto node_attr_1 = output_node_attr.index_select(0, source_nodes);
-        auto target_nodes = edge_index[1];
-        auto node_attr_2 = output_node_attr.index_select(0, target_nodes);
-        auto output_edge_attr = torch::cat({node_attr_1, node_attr_2}, -1);
-        return mlp->forward(output_edge_attr);
+        std::cout << "Incremental inference: " << num_removed << " edges removed, 4 added; " << dirty_rows
+                  << " node rows recomputed" << (update.full_recompute ? " (full recompute)" : "") << ", "
+                  << update.rescored_edges << " edges rescored; max difference to a full pass " << difference << ".\n";
     }
-protected:
-    GATConv<ActivationType, EndActivationType> gatconv1{nullptr};
-    GATConv<ActivationType, EndActivationType> gatconv2{nullptr};
-    MLP<ActivationType, EndActivationType> mlp{nullptr};
-    int k;
-};
-
-template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
-class NN : public torch::nn::ModuleHolder<NNImpl<ActivationType, EndActivationType>>
-{
-public:
-    using torch::nn::ModuleHolder<NNImpl<ActivationType, EndActivationType>>::ModuleHolder;
-    using Impl TORCH_UNUSED_EXCEPT_CUDA = NNImpl<ActivationType, EndActivationType>;
-};
-
-int main()
-{
-    auto start = std::chrono::steady_clock::now();
-    
-    YAML::Node config = YAML::LoadFile("../configs/training_parameters.yaml");
-    int num_epochs = config["num_epochs"].as<int>();
-    float lr = config["lr"].as<float>();
 
-    std::mt19937 gen;
-    std::normal_distribution d{30.0, 3.0};
-    std::vector<torch::Tensor> graph_node_features(100);
-    std::vector<torch::Tensor> graph_edge_index(100);
-    std::vector<torch::Tensor> graph_edge_features(100);
-    std::vector<torch::Tensor> graph_edge_labels(100);
-    std::vector<torch::Tensor> graph_edge_weights(100);
-    for (int i = 0; i < 100; ++i)
+    // Every graph twice through the memory-planned executor: the first pass records one plan per shape bucket,
+    // the second replays them from the arenas.
+    if (config["planned_inference"].as<bool>(false))
     {
-        int graph_size = std::lround(d(gen));
-        graph_node_features[i] = torch::rand({graph_size, 3});
-        torch::Tensor adjacency_matrix = torch::rand({graph_size, graph_size});
-        graph_edge_index[i] = torch::argwhere(adjacency_matrix.tril(-1) > 0.7).transpose(0, 1);
-        graph_edge_features[i] = graph_node_features[i].index_select(0, graph_edge_index[i][0]) - graph_node_features[i].index_select(0, graph_edge_index[i][1]);
-        graph_edge_labels[i] = torch::rand({graph_edge_index[i].size(1), 1});
-        graph_edge_weights[i] = torch::ones({graph_edge_index[i].size(1), 1});
-    }
-
-    float epoch_array[num_epochs];
-    float loss_array[num_epochs];
-
-    std::vector<int> hidden_sizes = {64, 64};
-    std::vector<int> hidden_sizes_mlp = {80, 80};
-    auto model = NN<torch::nn::ReLU, torch::nn::Identity>(3, hidden_sizes, hidden_sizes, hidden_sizes_mlp, 32, 3);
-    torch::optim::Adam opt(model->parameters(), lr);
-    torch::nn::MSELoss loss_fn;
-    torch::nn::L1Loss metric_fn;
-    for (int epoch = 0; epoch < num_epochs; ++epoch)
-    {
-        float epoch_loss = 0;
-        float epoch_metric = 0;
-        for (int i = 0; i < 100; ++i)
+        PlannedInferenceExecutor planned(model);
+        for (int pass = 0; pass < 2; ++pass)
         {
-            torch::Tensor pred = model->forward(graph_edge_index[i], graph_node_features[i], graph_edge_features[i], graph_edge_weights[i]);
-            torch::Tensor loss = loss_fn(pred, graph_edge_labels[i]);
-            torch::Tensor metric = metric_fn(pred, graph_edge_labels[i]);
-            loss.backward();
-            opt.step();
-            opt.zero_grad();
-            epoch_loss += loss.item<float>();
-            epoch_metric += metric.item<float>();
+            for (int i = 0; i < num_graphs; ++i)
+            {
+                const auto graph = dataset.graph(i);
+                planned.score(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight);
+            }
         }
-        std::cout << "epoch:\t" << epoch << ";\tloss:\t" << epoch_loss / 100 << ";\tmetric:\t" << epoch_metric / 100 << '\n';
-        epoch_array[epoch] = (float)epoch;
-        loss_array[epoch] = epoch_loss / 100;
+        const auto planned_stats = planned.stats();
+        std::cout << "Planned inference: " << planned_stats.buckets << " shape buckets, " << planned_stats.arena_bytes
+                  << " B of arenas for " << planned_stats.planned_allocations << " buffers; " << planned_stats.replays
+                  << " replays with " << planned_stats.fallback_allocations << " heap allocations.\n";
     }
 
-    rootplot(epoch_array, loss_array, num_epochs, "plot");
-    
     auto finish = std::chrono::steady_clock::now();
     std::chrono::duration<double> elapsed = finish - start;
     std::cout << "Total CPU/GPU time: " << elapsed.count() << " s.\n";
+    std::cout << "Peak RSS: " << peak_resident_set_size_bytes() / (1024.0 * 1024.0) << " MB.\n";
     
     return 0;
 }
@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Double with lock-free add, stored as its bit pattern.
+class AtomicDouble
+{
+public:
+    void store(const double value)
+    {
+        bits.store(to_bits(value), std::memory_order_relaxed);
+    }
+
+    double load() const
+    {
+        return from_bits(bits.load(std::memory_order_relaxed));
+    }
+
+    void add(const double value)
+    {
+        std::uint64_t expected = bits.load(std::memory_order_relaxed);
+        while (!bits.compare_exchange_weak(expected, to_bits(from_bits(expected) + value), std::memory_order_relaxed))
+        {
+        }
+    }
+
+private:
+    static std::uint64_t to_bits(const double value)
+    {
+        std::uint64_t result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+
+    static double from_bits(const std::uint64_t value)
+    {
+        double result;
+        std::memcpy(&result, &value, sizeof(result));
+        return result;
+    }
+
+    std::atomic<std::uint64_t> bits{0};
+};
+
+class Counter
+{
+public:
+    void increment(const double value = 1.0)
+    {
+        total.add(value);
+    }
+
+    double value() const
+    {
+        return total.load();
+    }
+
+private:
+    AtomicDouble total;
+};
+
+class Gauge
+{
+public:
+    void set(const double value)
+    {
+        current.store(value);
+    }
+
+    void add(const double value)
+    {
+        current.add(value);
+    }
+
+    double value() const
+    {
+        return current.load();
+    }
+
+private:
+    AtomicDouble current;
+};
+
+class Histogram
+{
+public:
+    explicit Histogram(std::vector<double> upper_bounds)
+    {
+        if (upper_bounds.empty() || !std::is_sorted(upper_bounds.begin(), upper_bounds.end()))
+        {
+            throw std::invalid_argument("Histogram::Histogram: upper_bounds must be non-empty and sorted.");
+        }
+        bounds = std::move(upper_bounds);
+        buckets = std::make_unique<std::atomic<std::uint64_t>[]>(bounds.size() + 1);
+        for (std::size_t i = 0; i <= bounds.size(); ++i)
+        {
+            buckets[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void observe(const double value)
+    {
+        const auto bucket = std::lower_bound(bounds.begin(), bounds.end(), value) - bounds.begin();
+        buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        sum.add(value);
+    }
+
+    const std::vector<double>& upper_bounds() const
+    {
+        return bounds;
+    }
+
+    // Non-cumulative count of bucket i; bucket upper_bounds().size() is the +Inf overflow bucket.
+    std::uint64_t bucket_count(const std::size_t i) const
+    {
+        return buckets[i].load(std::memory_order_relaxed);
+    }
+
+    double total() const
+    {
+        return sum.load();
+    }
+
+    // Buckets from start * factor^0 up to start * factor^(count - 1).
+    static std::vector<double> exponential_bounds(const double start, const double factor, const int count)
+    {
+        std::vector<double> result;
+        double bound = start;
+        for (int i = 0; i < count; ++i)
+        {
+            result.push_back(bound);
+            bound *= factor;
+        }
+        return result;
+    }
+
+private:
+    std::vector<double> bounds;
+    std::unique_ptr<std::atomic<std::uint64_t>[]> buckets;
+    AtomicDouble sum;
+};
+
+// Registry of metrics rendered in the Prometheus text exposition format. Registration takes a lock and is meant
+// for setup; the returned references stay valid for the registry's lifetime and are updated lock-free.
+class MetricsRegistry
+{
+public:
+    Counter& counter(const std::string& name, const std::string& help)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.emplace_back(name, help);
+        return counters.back().metric;
+    }
+
+    Gauge& gauge(const std::string& name, const std::string& help)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        gauges.emplace_back(name, help);
+        return gauges.back().metric;
+    }
+
+    Histogram& histogram(const std::string& name, const std::string& help, std::vector<double> upper_bounds)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        histograms.emplace_back(name, help, std::move(upper_bounds));
+        return histograms.back().metric;
+    }
+
+    std::string render() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::ostringstream out;
+        out.precision(12);
+        for (const auto& entry : counters)
+        {
+            out << "# HELP " << entry.name << ' ' << entry.help << "\n# TYPE " << entry.name << " counter\n"
+                << entry.name << ' ' << entry.metric.value() << '\n';
+        }
+        for (const auto& entry : gauges)
+        {
+            out << "# HELP " << entry.name << ' ' << entry.help << "\n# TYPE " << entry.name << " gauge\n"
+                << entry.name << ' ' << entry.metric.value() << '\n';
+        }
+        for (const auto& entry : histograms)
+        {
+            out << "# HELP " << entry.name << ' ' << entry.help << "\n# TYPE " << entry.name << " histogram\n";
+            const auto& bounds = entry.metric.upper_bounds();
+            std::uint64_t cumulative = 0;
+            for (std::size_t i = 0; i < bounds.size(); ++i)
+            {
+                cumulative += entry.metric.bucket_count(i);
+                out << entry.name << "_bucket{le=\"" << bounds[i] << "\"} " << cumulative << '\n';
+            }
+            cumulative += entry.metric.bucket_count(bounds.size());
+            out << entry.name << "_bucket{le=\"+Inf\"} " << cumulative << '\n'
+                << entry.name << "_sum " << entry.metric.total() << '\n'
+                << entry.name << "_count " << cumulative << '\n';
+        }
+        return out.str();
+    }
+
+private:
+    template <typename Metric>
+    struct Entry
+    {
+        template <typename... Args>
+        Entry(std::string name, std::string help, Args&&... args)
+            : name(std::move(name)), help(std::move(help)), metric(std::forward<Args>(args)...)
+        {
+        }
+
+        std::string name;
+        std::string help;
+        Metric metric;
+    };
+
+    mutable std::mutex mutex;
+    // std::deque never relocates its elements on emplace_back, which keeps handed-out references valid.
+    std::deque<Entry<Counter>> counters;
+    std::deque<Entry<Gauge>> gauges;
+    std::deque<Entry<Histogram>> histograms;
+};
+
+// Periodically writes a registry to a file for node_exporter's textfile collector. Each flush writes a temporary
+// file next to the target and renames it over the target, so the collector never reads a partial file.
+class PrometheusFileExporter
+{
+public:
+    PrometheusFileExporter(const MetricsRegistry& registry, const std::string& filename, const std::chrono::milliseconds interval)
+        : registry(registry)
+    {
+        this->filename = filename;
+        this->interval = interval;
+        writer = std::thread([this]() { run(); });
+    }
+
+    PrometheusFileExporter(const PrometheusFileExporter&) = delete;
+    PrometheusFileExporter& operator=(const PrometheusFileExporter&) = delete;
+
+    // Stops the background thread after a final flush.
+    ~PrometheusFileExporter()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        writer.join();
+    }
+
+    bool flush()
+    {
+        const auto temporary = filename + ".tmp";
+        std::FILE* file = std::fopen(temporary.c_str(), "w");
+        if (!file)
+        {
+            return false;
+        }
+        const auto text = registry.render();
+        const bool written = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+        if (std::fclose(file) != 0 || !written)
+        {
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return std::rename(temporary.c_str(), filename.c_str()) == 0;
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping)
+        {
+            condition.wait_for(lock, interval, [this]() { return stopping; });
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    const MetricsRegistry& registry;
+    std::string filename;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+    std::thread writer;
+};
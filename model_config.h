@@ -0,0 +1,64 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <yaml-cpp/yaml.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "nn.h"
+
+using GraphModel = NN<torch::nn::ReLU, torch::nn::Identity>;
+
+// Builds the model from the architecture keys of the training configuration, so that every tool loading a
+// checkpoint constructs the same module tree as the trainer that wrote it.
+inline GraphModel make_model(const YAML::Node& config)
+{
+    auto hidden_sizes = config["hidden_sizes"].as<std::vector<int>>(std::vector<int>{64, 64});
+    auto hidden_sizes_mlp = config["hidden_sizes_mlp"].as<std::vector<int>>(std::vector<int>{80, 80});
+    GraphModel model(config["node_attr_size"].as<int>(3),
+                     hidden_sizes,
+                     hidden_sizes,
+                     hidden_sizes_mlp,
+                     config["output_node_attr_size"].as<int>(32),
+                     config["edge_attr_size"].as<int>(3));
+
+    // Only changes how GATConv evaluates, not its parameters, so checkpoints load under any setting.
+    const auto order = config["aggregation_order"].as<std::string>("automatic");
+    if (order == "aggregate_first")
+    {
+        model->set_aggregation_order(AggregationOrder::aggregate_first);
+    }
+    else if (order == "transform_first")
+    {
+        model->set_aggregation_order(AggregationOrder::transform_first);
+    }
+    else if (order != "automatic")
+    {
+        throw std::invalid_argument("make_model: aggregation_order must be automatic, aggregate_first or transform_first.");
+    }
+    model->set_concurrent_branches(config["concurrent_branch_max_edges"].as<int64_t>(0));
+
+    // Per module: none, lossless, bfloat16 or int8 (see activation_compression.h).
+    if (const auto storage = config["activation_storage"])
+    {
+        ActivationStorageConfig activation_storage;
+        activation_storage.gatconv1 = parse_activation_storage(storage["gatconv1"].as<std::string>("none"));
+        activation_storage.gatconv2 = parse_activation_storage(storage["gatconv2"].as<std::string>("none"));
+        activation_storage.readout = parse_activation_storage(storage["readout"].as<std::string>("none"));
+        model->set_activation_storage(activation_storage);
+    }
+    // Spills the inputs of iterations 1 to `iterations` to a scratch file during training (see activation_offload.h).
+    if (const auto offload = config["activation_offload"])
+    {
+        const auto iterations = offload["iterations"].as<int>(0);
+        if (iterations > 0)
+        {
+            model->set_activation_offload(std::make_shared<ActivationOffload>(offload["directory"].as<std::string>("/tmp"),
+                                                                              offload["max_pending_mb"].as<int64_t>(256) << 20),
+                                          iterations);
+        }
+    }
+    return model;
+}
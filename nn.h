@@ -0,0 +1,752 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "activation_compression.h"
+#include "concurrent_branches.h"
+#include "cost_model.h"
+#include "perf_counters.h"
+#include "shared_topology.h"
+
+template <typename ActivationType = torch::nn::Tanh,
+typename EndActivationType = torch::nn::Identity>
+class MLPImpl final : public torch::nn::Module
+{
+public:
+    MLPImpl(const int input_size,
+            const std::vector<int>& hidden_sizes,
+            const int output_size,
+            const double dropout_prob = 0.0,
+            const bool use_layer_norm = true)
+    {
+        if (input_size < 1)
+        {
+            throw std::invalid_argument("MLPImpl::MLPImpl: input_size cannot be less than one.");
+        }
+
+        if (output_size < 1)
+        {
+            throw std::invalid_argument("MLPImpl::MLPImpl: output_size cannot be less than one.");
+        }
+
+        if(hidden_sizes.empty())
+        {
+            throw std::invalid_argument("MLPImpl::MLPImpl: hidden_sizes cannot be empty.");
+        }
+
+        for(auto& it : hidden_sizes)
+        {
+            if (it < 1)
+            {
+                throw std::invalid_argument("MLPImpl::MLPImpl: All components of hidden_sizes must be greater than zero.");
+            }
+        }
+
+        model = register_module("model", torch::nn::Sequential());
+
+        model->push_back(torch::nn::Linear(input_size, hidden_sizes[0]));
+
+        if (use_layer_norm)
+        {
+            model->push_back(torch::nn::LayerNorm(torch::nn::LayerNormOptions({hidden_sizes[0]})));
+        }
+
+        model->push_back(ActivationType());
+
+        if (dropout_prob > 0.0)
+        {
+            model->push_back(torch::nn::Dropout(dropout_prob));
+        }
+
+        for (size_t i = 1; i < hidden_sizes.size(); ++i)
+        {
+            model->push_back(torch::nn::Linear(hidden_sizes[i-1], hidden_sizes[i]));
+
+            if (use_layer_norm)
+            {
+                model->push_back(torch::nn::LayerNorm(torch::nn::LayerNormOptions({hidden_sizes[i]})));
+            }
+
+            model->push_back(ActivationType());
+
+            if (dropout_prob > 0.0)
+            {
+                model->push_back(torch::nn::Dropout(dropout_prob));
+            }
+        }
+
+        model->push_back(torch::nn::Linear(hidden_sizes.back(), output_size));
+
+        if constexpr(!std::is_same_v<EndActivationType, torch::nn::Identity>)
+        {
+            model->push_back(EndActivationType());
+        }
+    }
+
+    ~MLPImpl() override = default;
+
+    torch::Tensor forward(torch::Tensor x)
+    {
+        PerfScope scope(PerfRegion::mlp);
+        return model->forward(x);
+    }
+
+    // The first layer, and the layers after it: forward(x) equals forward_after_first(first_linear()->forward(x)).
+    std::shared_ptr<torch::nn::LinearImpl> first_linear() const
+    {
+        return model->ptr<torch::nn::LinearImpl>(0);
+    }
+
+    torch::Tensor forward_after_first(torch::Tensor x)
+    {
+        PerfScope scope(PerfRegion::mlp);
+        for (auto it = model->begin() + 1; it != model->end(); ++it)
+        {
+            x = it->forward(x);
+        }
+        return x;
+    }
+
+    // Floating point operations of a forward pass over `rows` rows: 2 * in * out per row for every Linear and
+    // a per-element estimate for layer norms and activations.
+    double estimate_flops(const int64_t rows) const
+    {
+        double flops = 0.0;
+        int64_t last_width = 0;
+        for (const auto& module : model->children())
+        {
+            if (const auto* linear = module->as<torch::nn::Linear>())
+            {
+                flops += 2.0 * static_cast<double>(rows) * linear->options.in_features() * linear->options.out_features();
+                last_width = linear->options.out_features();
+            }
+            else if (module->as<torch::nn::LayerNorm>())
+            {
+                flops += 8.0 * static_cast<double>(rows) * last_width;
+            }
+            else
+            {
+                flops += static_cast<double>(rows) * last_width;
+            }
+        }
+        return flops;
+    }
+
+private:
+    torch::nn::Sequential model{nullptr};
+};
+
+template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
+class MLP : public torch::nn::ModuleHolder<MLPImpl<ActivationType, EndActivationType>>
+{
+public:
+    using torch::nn::ModuleHolder<MLPImpl<ActivationType, EndActivationType>>::ModuleHolder;
+    using Impl TORCH_UNUSED_EXCEPT_CUDA = MLPImpl<ActivationType, EndActivationType>;
+};
+
+// Order of GATConv's propagations and its MLP's first layer. Both are linear, so projecting the node attributes
+// to the first hidden width before propagating them gives the same output as propagating the wide attributes.
+enum class AggregationOrder
+{
+    automatic,
+    aggregate_first,
+    transform_first
+};
+
+template <typename ActivationType = torch::nn::Tanh,
+typename EndActivationType = torch::nn::Identity>
+class GATConvImpl : public torch::nn::Module
+{
+public:
+    GATConvImpl(const int input_node_attr_size,
+                const std::vector<int>& hidden_sizes,
+                const int output_node_attr_size,
+                const int initial_node_attr_size,
+                const int edge_attr_size,
+                const double dropout_prob = 0.0,
+                const bool use_layer_norm = true)
+    {
+        if (input_node_attr_size < 1)
+        {
+            throw std::invalid_argument("GATConvImpl::GATConvImpl: input_node_attr_size cannot be less than one.");
+        }
+
+        if (output_node_attr_size < 1)
+        {
+            throw std::invalid_argument("GATConvImpl::GATConvImpl: output_node_attr_size cannot be less than one.");
+        }
+
+        if (initial_node_attr_size < 1)
+        {
+            throw std::invalid_argument("GATConvImpl::GATConvImpl: initial_node_attr_size cannot be less than one.");
+        }
+
+        if (edge_attr_size < 1)
+        {
+            throw std::invalid_argument("GATConvImpl::GATConvImpl: edge_attr_size cannot be less than one.");
+        }
+
+        if(hidden_sizes.empty())
+        {
+            throw std::invalid_argument("GATConvImpl::GATConvImpl: hidden_sizes cannot be empty.");
+        }
+
+        for(auto& it : hidden_sizes)
+        {
+            if (it < 1)
+            {
+                throw std::invalid_argument("GATConvImpl::GATConvImpl: All components of hidden_sizes must be greater than zero.");
+            }
+        }
+
+        this->input_node_attr_size = input_node_attr_size;
+        this->initial_node_attr_size = initial_node_attr_size;
+        this->edge_attr_size = edge_attr_size;
+        this->first_hidden_size = hidden_sizes[0];
+        mlp = register_module("mlp", MLP<ActivationType, EndActivationType>(5 * input_node_attr_size + initial_node_attr_size + 4 * edge_attr_size,
+                                                                            hidden_sizes,
+                                                                            output_node_attr_size,
+                                                                            dropout_prob,
+                                                                            use_layer_norm));
+    }
+
+    virtual ~GATConvImpl() override = default;
+
+    void set_aggregation_order(const AggregationOrder order)
+    {
+        aggregation_order = order;
+    }
+
+    // Graphs with at most max_edges edges run the incoming and outgoing propagation chains concurrently; zero
+    // keeps them sequential. Only small graphs gain: large ones already keep every core busy within each operator.
+    void set_concurrent_branches(const int64_t max_edges)
+    {
+        concurrent_branch_max_edges = max_edges;
+    }
+
+    bool runs_branches_concurrently(const int64_t num_edges) const
+    {
+        return concurrent_branch_max_edges > 0 && num_edges <= concurrent_branch_max_edges && at::get_num_interop_threads() > 1;
+    }
+
+    bool transforms_first(const int64_t num_nodes, const int64_t num_edges) const
+    {
+        if (aggregation_order != AggregationOrder::automatic)
+        {
+            return aggregation_order == AggregationOrder::transform_first;
+        }
+        return transform_first_flops(num_nodes, num_edges) < aggregate_first_flops(num_nodes, num_edges);
+    }
+
+    virtual torch::Tensor forward(torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor initial_node_attr)
+    {
+        if (transforms_first(node_attr.size(0), edge_index.size(1)))
+        {
+            return forward_transform_first(edge_index, node_attr, edge_attr, edge_weight, initial_node_attr);
+        }
+        return forward_propagated(propagate_features(edge_index, node_attr, edge_attr, edge_weight, initial_node_attr));
+    }
+
+    // forward() for a batch of events sharing one graph structure: node_attr and initial_node_attr are [N, B, F],
+    // edge_attr is [E, B, Fe] and the result is [N, B, output_node_attr_size].
+    torch::Tensor forward_shared(const SharedTopology& topology, torch::Tensor node_attr,
+                                 torch::Tensor edge_attr, torch::Tensor initial_node_attr)
+    {
+        auto one_hop_incoming = torch::cat({shared_propagate(topology.incoming, node_attr),
+                                            shared_propagate(topology.incoming_edges, edge_attr)}, -1);
+        auto one_hop_outgoing = torch::cat({shared_propagate(topology.outgoing, node_attr),
+                                            shared_propagate(topology.outgoing_edges, edge_attr)}, -1);
+        auto two_hop_incoming = shared_propagate(topology.incoming, one_hop_incoming);
+        auto two_hop_outgoing = shared_propagate(topology.outgoing, one_hop_outgoing);
+
+        return mlp->forward(torch::cat({initial_node_attr, node_attr,
+            one_hop_incoming, one_hop_outgoing,
+            two_hop_incoming, two_hop_outgoing}, -1));
+    }
+
+    // Second half of forward(): the MLP applied to the output of propagate_features().
+    torch::Tensor forward_propagated(torch::Tensor propagated)
+    {
+        return mlp->forward(propagated);
+    }
+
+    // First half of forward(): initial and current node attributes concatenated with the one- and two-hop
+    // incoming and outgoing aggregates. It has no parameters, so for fixed inputs it can be computed once.
+    virtual torch::Tensor propagate_features(torch::Tensor edge_index, torch::Tensor node_attr,
+                                             torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor initial_node_attr)
+    {
+        auto reversed_edge_index = edge_index.flip(0);
+
+        // Each direction is one chain: its two-hop term propagates its own one-hop aggregates.
+        const auto chain = [&](torch::Tensor direction)
+        {
+            auto one_hop = propagate(direction, node_attr, edge_attr, edge_weight, 1);
+            return std::make_pair(one_hop, propagate(direction, one_hop, edge_attr, edge_weight, 2));
+        };
+        std::pair<torch::Tensor, torch::Tensor> incoming, outgoing;
+        if (runs_branches_concurrently(edge_index.size(1)))
+        {
+            std::tie(incoming, outgoing) = run_concurrently([&]() { return chain(edge_index); },
+                                                            [&]() { return chain(reversed_edge_index); });
+        }
+        else
+        {
+            incoming = chain(edge_index);
+            outgoing = chain(reversed_edge_index);
+        }
+
+        return torch::cat({initial_node_attr, node_attr,
+            incoming.first, outgoing.first,
+            incoming.second, outgoing.second}, -1);
+    }
+
+    // Floating point operations of one forward pass in the order forward() picks.
+    double estimate_flops(const int64_t num_nodes, const int64_t num_edges) const
+    {
+        return transforms_first(num_nodes, num_edges) ? transform_first_flops(num_nodes, num_edges)
+                                                      : aggregate_first_flops(num_nodes, num_edges);
+    }
+
+    // Each of the four propagations scales and sums E * (input_node_attr_size + edge_attr_size) message
+    // elements, then the MLP runs on every node.
+    double aggregate_first_flops(const int64_t num_nodes, const int64_t num_edges) const
+    {
+        const double message_width = input_node_attr_size + edge_attr_size;
+        return 4.0 * 2.0 * static_cast<double>(num_edges) * message_width + mlp->estimate_flops(num_nodes);
+    }
+
+    // The node attributes are propagated at the first hidden width: 2H wide for the first hop of each direction
+    // (one-hop term and input of the two-hop term), H wide for the second. Edge attributes are still propagated
+    // at their own width. The first layer costs the same in both orders, so only the widths decide.
+    double transform_first_flops(const int64_t num_nodes, const int64_t num_edges) const
+    {
+        const double message_width = 6.0 * first_hidden_size + 4.0 * edge_attr_size;
+        return 2.0 * static_cast<double>(num_edges) * message_width + mlp->estimate_flops(num_nodes);
+    }
+
+protected:
+    // forward() with the node attributes projected by the matching column blocks of the first layer's weight
+    // before they are propagated. The two-hop terms propagate the projected one-hop aggregates again.
+    torch::Tensor forward_transform_first(torch::Tensor edge_index, torch::Tensor node_attr,
+                                          torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor initial_node_attr)
+    {
+        const int64_t F = input_node_attr_size;
+        const int64_t Fe = edge_attr_size;
+        const int64_t H = first_hidden_size;
+        const auto num_nodes = node_attr.size(0);
+        auto linear = mlp->first_linear();
+        // Column blocks in the order propagate_features() concatenates its outputs: initial, node, then node and
+        // edge parts of the one-hop incoming, one-hop outgoing, two-hop incoming and two-hop outgoing aggregates.
+        auto blocks = linear->weight.split_with_sizes({initial_node_attr_size, F, F, Fe, F, Fe, F, Fe, F, Fe}, 1);
+        auto reversed_edge_index = edge_index.flip(0);
+
+        auto weighted_edge_attr = edge_weight * edge_attr;
+
+        // Four independent chains: projected node attributes and raw edge attributes, each in both directions.
+        // A node chain returns its one-hop aggregate and its two-hop one, an edge chain the same for edge attributes.
+        const auto node_chain = [&](torch::Tensor direction, torch::Tensor weight)
+        {
+            auto one_hop = propagate(direction, torch::matmul(node_attr, weight.t()), edge_attr, edge_weight, 2);
+            return std::make_pair(one_hop, propagate(direction, one_hop.narrow(1, H, H), edge_attr, edge_weight, 2));
+        };
+        const auto edge_chain = [&](torch::Tensor direction)
+        {
+            torch::Tensor one_hop;
+            {
+                PerfScope scope(PerfRegion::aggregate);
+                one_hop = aggregate(direction, weighted_edge_attr, num_nodes);
+            }
+            return std::make_pair(one_hop, propagate(direction, one_hop, edge_attr, edge_weight, 2));
+        };
+        const auto direction_chains = [&](torch::Tensor direction, torch::Tensor weight, const bool concurrent)
+        {
+            if (concurrent)
+            {
+                return run_concurrently([&]() { return node_chain(direction, weight); },
+                                        [&]() { return edge_chain(direction); });
+            }
+            return std::make_pair(node_chain(direction, weight), edge_chain(direction));
+        };
+
+        auto incoming_weight = torch::cat({blocks[2], blocks[6]}, 0);
+        auto outgoing_weight = torch::cat({blocks[4], blocks[8]}, 0);
+        std::pair<std::pair<torch::Tensor, torch::Tensor>, std::pair<torch::Tensor, torch::Tensor>> incoming, outgoing;
+        if (runs_branches_concurrently(edge_index.size(1)))
+        {
+            std::tie(incoming, outgoing) = run_concurrently([&]() { return direction_chains(edge_index, incoming_weight, true); },
+                                                            [&]() { return direction_chains(reversed_edge_index, outgoing_weight, true); });
+        }
+        else
+        {
+            incoming = direction_chains(edge_index, incoming_weight, false);
+            outgoing = direction_chains(reversed_edge_index, outgoing_weight, false);
+        }
+
+        auto narrow_inputs = torch::cat({initial_node_attr, node_attr, incoming.second.first, outgoing.second.first,
+                                         incoming.second.second, outgoing.second.second}, -1);
+        auto narrow_weight = torch::cat({blocks[0], blocks[1], blocks[3], blocks[5], blocks[7], blocks[9]}, 1);
+        auto hidden = torch::addmm(linear->bias, narrow_inputs, narrow_weight.t())
+                      + incoming.first.first.narrow(1, 0, H) + outgoing.first.first.narrow(1, 0, H)
+                      + incoming.first.second + outgoing.first.second;
+        return mlp->forward_after_first(hidden);
+    }
+
+    virtual torch::Tensor propagate(torch::Tensor edge_index, torch::Tensor node_attr,
+                                    torch::Tensor edge_attr, torch::Tensor edge_weight, int hop)
+    {
+        torch::Tensor messages;
+        {
+            PerfScope scope(PerfRegion::message);
+            messages = message(edge_index, node_attr, edge_attr, edge_weight, hop);
+        }
+
+        PerfScope scope(PerfRegion::aggregate);
+        return aggregate(edge_index, messages, node_attr.size(0));
+    }
+
+    virtual torch::Tensor message(torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight, int hop)
+    {
+        auto source_nodes = edge_index[0];
+        auto node_attr_j = node_attr.index_select(0, source_nodes);
+
+        if(hop == 1)
+        {
+            return edge_weight * torch::cat({node_attr_j, edge_attr}, -1);
+        }
+        else
+        {
+            return edge_weight * node_attr_j;
+        }
+    }
+
+    virtual torch::Tensor aggregate(torch::Tensor edge_index, torch::Tensor messages, int num_nodes)
+    {
+        auto target_nodes = edge_index[1];
+
+        return torch::zeros({num_nodes, messages.size(1)}, messages.options()).index_add_(0, target_nodes, messages);
+    }
+
+    MLP<ActivationType, EndActivationType> mlp{nullptr};
+    int input_node_attr_size;
+    int initial_node_attr_size;
+    int edge_attr_size;
+    int first_hidden_size;
+    AggregationOrder aggregation_order = AggregationOrder::automatic;
+    int64_t concurrent_branch_max_edges = 0;
+};
+
+template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
+class GATConv : public torch::nn::ModuleHolder<GATConvImpl<ActivationType, EndActivationType>>
+{
+public:
+    using torch::nn::ModuleHolder<GATConvImpl<ActivationType, EndActivationType>>::ModuleHolder;
+    using Impl TORCH_UNUSED_EXCEPT_CUDA = GATConvImpl<ActivationType, EndActivationType>;
+};
+
+template <typename ActivationType = torch::nn::Tanh,
+typename EndActivationType = torch::nn::Identity>
+class NNImpl : public torch::nn::Module
+{
+public:
+    NNImpl(const int node_attr_size,
+           const std::vector<int>& hidden_sizes_1,
+           const std::vector<int>& hidden_sizes_2,
+           const std::vector<int>& hidden_sizes_mlp,
+           const int output_node_attr_size,
+           const int edge_attr_size,
+           const double dropout_prob = 0.0,
+           const bool use_layer_norm = true,
+           const int k = 6)
+    {
+        gatconv1 = register_module("gatconv1", GATConv<ActivationType, EndActivationType>(node_attr_size,
+                                                                                          hidden_sizes_1,
+                                                                                          output_node_attr_size,
+                                                                                          node_attr_size,
+                                                                                          edge_attr_size,
+                                                                                          dropout_prob,
+                                                                                          use_layer_norm));
+        gatconv2 = register_module("gatconv2", GATConv<ActivationType, EndActivationType>(output_node_attr_size,
+                                                                                          hidden_sizes_2,
+                                                                                          output_node_attr_size,
+                                                                                          node_attr_size,
+                                                                                          edge_attr_size,
+                                                                                          dropout_prob,
+                                                                                          use_layer_norm));
+        mlp = register_module("mlp", MLP<ActivationType, EndActivationType>(2 * output_node_attr_size,
+                                                                            hidden_sizes_mlp,
+                                                                            1,
+                                                                            dropout_prob,
+                                                                            use_layer_norm));
+        this->k = k;
+    }
+    virtual ~NNImpl() override = default;
+    virtual torch::Tensor forward(torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight)
+    {
+        return readout(edge_index, embed(edge_index, node_attr, edge_attr, edge_weight));
+    }
+
+    // Same as forward() with gatconv1's propagation taken from input_aggregates(), so only its MLP runs.
+    virtual torch::Tensor forward(torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor input_aggregates)
+    {
+        return readout(edge_index, embed(edge_index, node_attr, edge_attr, edge_weight, input_aggregates));
+    }
+
+    // gatconv1 propagates the raw graph inputs, which no parameter influences: the result is the same in every
+    // epoch and can be cached per graph. Computed without autograd, since nothing upstream needs gradients.
+    torch::Tensor input_aggregates(torch::Tensor edge_index, torch::Tensor node_attr,
+                                   torch::Tensor edge_attr, torch::Tensor edge_weight)
+    {
+        torch::NoGradGuard no_grad;
+        return gatconv1->propagate_features(edge_index, node_attr, edge_attr, edge_weight, node_attr);
+    }
+
+    // Node embeddings after all k message passing iterations (output_node_attr). If input_aggregates is given,
+    // the first iteration only runs gatconv1's MLP on it.
+    virtual torch::Tensor embed(torch::Tensor edge_index, torch::Tensor node_attr,
+                                torch::Tensor edge_attr, torch::Tensor edge_weight,
+                                torch::Tensor input_aggregates = torch::Tensor())
+    {
+        torch::Tensor output_node_attr;
+        int first = 0;
+        if (input_aggregates.defined())
+        {
+            // The cached aggregates do not depend on parameters and stay in memory anyway: never spilled.
+            if (activation_storage.gatconv1 == ActivationStorage::none)
+            {
+                output_node_attr = gatconv1->forward_propagated(input_aggregates);
+            }
+            else
+            {
+                auto gatconv = gatconv1;
+                output_node_attr = run_with_activation_storage(activation_storage.gatconv1, [gatconv](const std::vector<torch::Tensor>& inputs)
+                {
+                    return gatconv->forward_propagated(inputs[0]);
+                }, {input_aggregates}, gatconv->parameters());
+            }
+            first = 1;
+        }
+        else
+        {
+            output_node_attr = node_attr;
+        }
+        for (int i = first; i < k; ++i)
+        {
+            output_node_attr = iterate(i, edge_index, output_node_attr, edge_attr, edge_weight, node_attr);
+        }
+        if (offload_iterations > 0 && output_node_attr.requires_grad())
+        {
+            // Backward reaches the embeddings after the readout: start reading the last spilled iteration input.
+            auto offload = activation_offload;
+            output_node_attr.register_hook([offload](torch::Tensor) { offload->prefetch_latest(); });
+        }
+        return output_node_attr;
+    }
+
+    // Scores of B events sharing the graph structure in topology: node_attr is [B, N, F] and edge_attr [B, E, Fe];
+    // the result is [B, E, 1]. Every propagation is one sparse product over all events, and the MLPs process the
+    // B * N (or B * E) rows at once.
+    virtual torch::Tensor forward_shared(const SharedTopology& topology, torch::Tensor node_attr, torch::Tensor edge_attr)
+    {
+        if (node_attr.dim() != 3 || edge_attr.dim() != 3 || node_attr.size(1) != topology.num_nodes
+            || edge_attr.size(1) != topology.num_edges || edge_attr.size(0) != node_attr.size(0))
+        {
+            throw std::invalid_argument("NNImpl::forward_shared: node_attr must be [B, N, F] and edge_attr [B, E, Fe] for the topology's N and E.");
+        }
+
+        // Nodes (edges) first, so that the features of all events of one node are contiguous.
+        auto initial_node_attr = node_attr.transpose(0, 1).contiguous();
+        auto shared_edge_attr = edge_attr.transpose(0, 1).contiguous();
+        auto output_node_attr = initial_node_attr;
+        for (int i = 0; i < k; ++i)
+        {
+            auto& gatconv = i == 0 ? gatconv1 : gatconv2;
+            output_node_attr = gatconv->forward_shared(topology, output_node_attr, shared_edge_attr, initial_node_attr);
+        }
+
+        auto output_edge_attr = torch::cat({output_node_attr.index_select(0, topology.sources),
+                                            output_node_attr.index_select(0, topology.targets)}, -1);
+        return mlp->forward(output_edge_attr).transpose(0, 1);
+    }
+
+    // Scores of an anytime forward pass together with the number of message passing iterations that were run.
+    struct AnytimeResult
+    {
+        torch::Tensor output;
+        int iterations;
+    };
+
+    // Forward pass that stops iterating gatconv2 once the cost model predicts that another iteration plus the
+    // readout would miss the deadline. gatconv1 and the readout always run, so at least one iteration is used;
+    // scores from fewer than k iterations are an approximation of the trained model's output.
+    virtual AnytimeResult forward(torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight,
+                                  const std::chrono::steady_clock::time_point deadline,
+                                  const IterationCostModel& cost_model)
+    {
+        auto embedding = embed_until(edge_index, node_attr, edge_attr, edge_weight, deadline, cost_model, edge_index.size(1));
+        return AnytimeResult{readout(edge_index, embedding.output), embedding.iterations};
+    }
+
+    // Node embeddings after as many iterations as fit before deadline while leaving time for the readout of
+    // readout_edges edges.
+    virtual AnytimeResult embed_until(torch::Tensor edge_index, torch::Tensor node_attr,
+                                      torch::Tensor edge_attr, torch::Tensor edge_weight,
+                                      const std::chrono::steady_clock::time_point deadline,
+                                      const IterationCostModel& cost_model,
+                                      const int64_t readout_edges)
+    {
+        if (!cost_model.is_calibrated())
+        {
+            throw std::invalid_argument("NNImpl::embed_until: cost_model must be calibrated.");
+        }
+
+        const auto num_nodes = node_attr.size(0);
+        const auto num_edges = edge_index.size(1);
+        const std::chrono::duration<double> readout_cost(cost_model.predict_readout(num_nodes, readout_edges));
+
+        torch::Tensor output_node_attr = iterate(0, edge_index, node_attr, edge_attr, edge_weight, node_attr);
+        int iterations = 1;
+        while (iterations < k)
+        {
+            const std::chrono::duration<double> iteration_cost(cost_model.predict_iteration(iterations, num_nodes, num_edges));
+            if (std::chrono::steady_clock::now() + iteration_cost + readout_cost > deadline)
+            {
+                break;
+            }
+            output_node_attr = iterate(iterations, edge_index, output_node_attr, edge_attr, edge_weight, node_attr);
+            ++iterations;
+        }
+        return AnytimeResult{output_node_attr, iterations};
+    }
+
+    // One message passing iteration: gatconv1 for iteration 0 and gatconv2 for the remaining k - 1.
+    virtual torch::Tensor iterate(const int iteration, torch::Tensor edge_index, torch::Tensor node_attr,
+                                  torch::Tensor edge_attr, torch::Tensor edge_weight, torch::Tensor initial_node_attr)
+    {
+        auto gatconv = iteration == 0 ? gatconv1 : gatconv2;
+        const auto storage = iteration == 0 ? activation_storage.gatconv1 : activation_storage.gatconv2;
+        auto* offload = offloaded_activations(iteration);
+        if (storage == ActivationStorage::none && !offload)
+        {
+            return gatconv->forward(edge_index, node_attr, edge_attr, edge_weight, initial_node_attr);
+        }
+        // Only node_attr depends on parameters; the graph inputs are kept as they are.
+        return run_with_activation_storage(storage, [=](const std::vector<torch::Tensor>& inputs)
+        {
+            return gatconv->forward(edge_index, inputs[0], edge_attr, edge_weight, initial_node_attr);
+        }, {node_attr}, gatconv->parameters(), offload);
+    }
+
+    int num_iterations() const
+    {
+        return k;
+    }
+
+    void set_aggregation_order(const AggregationOrder order)
+    {
+        gatconv1->set_aggregation_order(order);
+        gatconv2->set_aggregation_order(order);
+    }
+
+    void set_concurrent_branches(const int64_t max_edges)
+    {
+        gatconv1->set_concurrent_branches(max_edges);
+        gatconv2->set_concurrent_branches(max_edges);
+    }
+
+    // Opt-in: trades recomputation in backward for the activation memory of the selected modules.
+    void set_activation_storage(const ActivationStorageConfig& storage)
+    {
+        activation_storage = storage;
+    }
+
+    const ActivationStorageConfig& get_activation_storage() const
+    {
+        return activation_storage;
+    }
+
+    // Opt-in: the inputs of the first `iterations` message passing iterations that depend on parameters, i.e.
+    // iterations 1 to `iterations`, whose activations wait longest for backward, are spilled to offload and
+    // recomputed from there. Iteration 0 reads the graph inputs, which spilling would not free; it and the later
+    // iterations follow the activation storage.
+    void set_activation_offload(std::shared_ptr<ActivationOffload> offload, const int iterations)
+    {
+        activation_offload = std::move(offload);
+        offload_iterations = activation_offload ? iterations : 0;
+    }
+
+    const std::shared_ptr<ActivationOffload>& get_activation_offload() const
+    {
+        return activation_offload;
+    }
+
+    int get_offload_iterations() const
+    {
+        return offload_iterations;
+    }
+
+    // Floating point operations of one forward pass; a training step costs about three times as much. With
+    // cached input aggregates gatconv1 only runs its MLP, whose cost does not depend on the edges.
+    double estimate_flops(const int64_t num_nodes, const int64_t num_edges, const bool cached_input_aggregates = false) const
+    {
+        return gatconv1->estimate_flops(num_nodes, cached_input_aggregates ? 0 : num_edges)
+               + (k - 1) * gatconv2->estimate_flops(num_nodes, num_edges)
+               + mlp->estimate_flops(num_edges);
+    }
+
+    // Edge scores for the edges in edge_index, which do not have to be the edges the embeddings were computed on.
+    virtual torch::Tensor readout(torch::Tensor edge_index, torch::Tensor output_node_attr)
+    {
+        if (activation_storage.readout == ActivationStorage::none)
+        {
+            return score_edges(edge_index, output_node_attr);
+        }
+        // Keeps the N node embeddings instead of the gathered [E, 2H] pairs and the MLP activations of every edge.
+        return run_with_activation_storage(activation_storage.readout, [this, edge_index](const std::vector<torch::Tensor>& inputs)
+        {
+            return score_edges(edge_index, inputs[0]);
+        }, {output_node_attr}, mlp->parameters());
+    }
+protected:
+    torch::Tensor score_edges(torch::Tensor edge_index, torch::Tensor output_node_attr)
+    {
+        auto source_nodes = edge_index[0];
+        auto node_attr_1 = output_node_attr.index_select(0, source_nodes);
+        auto target_nodes = edge_index[1];
+        auto node_attr_2 = output_node_attr.index_select(0, target_nodes);
+        auto output_edge_attr = torch::cat({node_attr_1, node_attr_2}, -1);
+        return mlp->forward(output_edge_attr);
+    }
+
+    GATConv<ActivationType, EndActivationType> gatconv1{nullptr};
+    GATConv<ActivationType, EndActivationType> gatconv2{nullptr};
+    MLP<ActivationType, EndActivationType> mlp{nullptr};
+    int k;
+    ActivationStorageConfig activation_storage;
+    std::shared_ptr<ActivationOffload> activation_offload;
+    int offload_iterations = 0;
+
+    ActivationOffload* offloaded_activations(const int iteration) const
+    {
+        return iteration >= 1 && iteration <= offload_iterations ? activation_offload.get() : nullptr;
+    }
+};
+
+template <typename ActivationType = torch::nn::Tanh, typename EndActivationType = torch::nn::Identity>
+class NN : public torch::nn::ModuleHolder<NNImpl<ActivationType, EndActivationType>>
+{
+public:
+    using torch::nn::ModuleHolder<NNImpl<ActivationType, EndActivationType>>::ModuleHolder;
+    using Impl TORCH_UNUSED_EXCEPT_CUDA = NNImpl<ActivationType, EndActivationType>;
+};
@@ -0,0 +1,541 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+#include "packed_dataset.h"
+
+// Readers for NumPy .npy files and .npz archives. Arrays are memory-mapped and wrapped with from_blob; each
+// tensor keeps the mapping alive, so no data is copied unless an array is stored compressed, big-endian or at
+// an offset that is not aligned to its element size (.npy headers are padded to keep data aligned, zip members
+// are not, so arrays inside .npz archives may need the copy). The mapping is private: writing to a tensor never
+// modifies the file.
+
+class MappedFile
+{
+public:
+    // A read-only mapping is shared: every process mapping the file reads the same page-cache pages, and writes
+    // through it fault.
+    explicit MappedFile(const std::string& path, const bool read_only = false)
+    {
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::invalid_argument("MappedFile::MappedFile: cannot open " + path + ".");
+        }
+
+        struct stat status;
+        if (fstat(fd, &status) != 0)
+        {
+            ::close(fd);
+            throw std::invalid_argument("MappedFile::MappedFile: cannot stat " + path + ".");
+        }
+        length = static_cast<std::size_t>(status.st_size);
+        if (length > 0)
+        {
+            address = read_only ? mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0)
+                                : mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        }
+        ::close(fd);
+        if (address == MAP_FAILED)
+        {
+            address = nullptr;
+            throw std::runtime_error("MappedFile::MappedFile: cannot map " + path + ".");
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (address)
+        {
+            munmap(address, length);
+        }
+    }
+
+    std::uint8_t* data() const
+    {
+        return static_cast<std::uint8_t*>(address);
+    }
+
+    std::size_t size() const
+    {
+        return length;
+    }
+
+private:
+    void* address = nullptr;
+    std::size_t length = 0;
+};
+
+struct NpyHeader
+{
+    torch::ScalarType dtype = torch::kFloat;
+    bool big_endian = false;
+    bool fortran_order = false;
+    std::vector<std::int64_t> shape;
+    std::size_t data_offset = 0;  // relative to the start of the .npy data
+};
+
+namespace npy_detail
+{
+    inline torch::ScalarType parse_dtype(const std::string& descr, bool& big_endian)
+    {
+        if (descr.size() < 3)
+        {
+            throw std::invalid_argument("parse_npy_header: unsupported dtype '" + descr + "'.");
+        }
+        // '<' little-endian, '>' big-endian, '|' not applicable (one byte), '=' native (written as '<' on x86).
+        big_endian = descr[0] == '>';
+        const auto kind = descr.substr(1);
+        static const std::map<std::string, torch::ScalarType> types = {
+            {"f2", torch::kHalf}, {"f4", torch::kFloat}, {"f8", torch::kDouble},
+            {"i1", torch::kChar}, {"i2", torch::kShort}, {"i4", torch::kInt}, {"i8", torch::kLong},
+            {"u1", torch::kByte}, {"b1", torch::kBool}};
+        auto it = types.find(kind);
+        if (it == types.end())
+        {
+            throw std::invalid_argument("parse_npy_header: unsupported dtype '" + descr + "'.");
+        }
+        if (torch::elementSize(it->second) == 1)
+        {
+            big_endian = false;
+        }
+        return it->second;
+    }
+
+    // Value of `key` in the header dictionary, e.g. "'<f4'" for 'descr' or "(3, 4)" for 'shape'.
+    inline std::string dictionary_value(const std::string& header, const std::string& key)
+    {
+        const auto position = header.find("'" + key + "'");
+        if (position == std::string::npos)
+        {
+            throw std::invalid_argument("parse_npy_header: missing key '" + key + "'.");
+        }
+        auto begin = header.find(':', position) + 1;
+        while (begin < header.size() && header[begin] == ' ')
+        {
+            ++begin;
+        }
+        std::size_t end;
+        if (header[begin] == '(')
+        {
+            end = header.find(')', begin) + 1;
+        }
+        else if (header[begin] == '\'')
+        {
+            end = header.find('\'', begin + 1) + 1;
+        }
+        else
+        {
+            end = header.find_first_of(",}", begin);
+        }
+        return header.substr(begin, end - begin);
+    }
+
+    inline std::uint16_t read_u16(const std::uint8_t* data)
+    {
+        return static_cast<std::uint16_t>(data[0] | (data[1] << 8));
+    }
+
+    inline std::uint32_t read_u32(const std::uint8_t* data)
+    {
+        return static_cast<std::uint32_t>(data[0]) | (static_cast<std::uint32_t>(data[1]) << 8)
+               | (static_cast<std::uint32_t>(data[2]) << 16) | (static_cast<std::uint32_t>(data[3]) << 24);
+    }
+
+    inline std::uint64_t read_u64(const std::uint8_t* data)
+    {
+        return static_cast<std::uint64_t>(read_u32(data)) | (static_cast<std::uint64_t>(read_u32(data + 4)) << 32);
+    }
+}
+
+inline NpyHeader parse_npy_header(const std::uint8_t* data, const std::size_t size)
+{
+    static const char magic[] = "\x93NUMPY";
+    if (size < 10 || std::memcmp(data, magic, 6) != 0)
+    {
+        throw std::invalid_argument("parse_npy_header: not a .npy array.");
+    }
+
+    const int major = data[6];
+    std::size_t header_length;
+    std::size_t header_start;
+    if (major == 1)
+    {
+        header_length = npy_detail::read_u16(data + 8);
+        header_start = 10;
+    }
+    else if (major == 2 || major == 3)
+    {
+        if (size < 12)
+        {
+            throw std::invalid_argument("parse_npy_header: truncated header.");
+        }
+        header_length = npy_detail::read_u32(data + 8);
+        header_start = 12;
+    }
+    else
+    {
+        throw std::invalid_argument("parse_npy_header: unsupported format version " + std::to_string(major) + ".");
+    }
+    if (header_start + header_length > size)
+    {
+        throw std::invalid_argument("parse_npy_header: truncated header.");
+    }
+
+    const std::string header(reinterpret_cast<const char*>(data + header_start), header_length);
+    NpyHeader result;
+    auto descr = npy_detail::dictionary_value(header, "descr");
+    result.dtype = npy_detail::parse_dtype(descr.substr(1, descr.size() - 2), result.big_endian);
+    result.fortran_order = npy_detail::dictionary_value(header, "fortran_order") == "True";
+
+    const auto shape = npy_detail::dictionary_value(header, "shape");
+    std::size_t position = 1;
+    while (position < shape.size())
+    {
+        const auto next = shape.find_first_of(",)", position);
+        const auto item = shape.substr(position, next - position);
+        if (item.find_first_not_of(' ') != std::string::npos)
+        {
+            result.shape.push_back(std::stoll(item));
+        }
+        position = next + 1;
+    }
+    result.data_offset = header_start + header_length;
+    return result;
+}
+
+// Wraps the array data at `data` (owned by `owner`) as a tensor; copies only when it cannot be used in place.
+inline torch::Tensor npy_tensor(const NpyHeader& header, std::uint8_t* data, const std::size_t available,
+                                std::shared_ptr<void> owner)
+{
+    std::int64_t numel = 1;
+    for (auto dimension : header.shape)
+    {
+        numel *= dimension;
+    }
+    const auto element_size = static_cast<std::size_t>(torch::elementSize(header.dtype));
+    if (static_cast<std::size_t>(numel) * element_size > available)
+    {
+        throw std::invalid_argument("npy_tensor: the array data is truncated.");
+    }
+
+    // Fortran order is row-major order of the reversed shape.
+    std::vector<std::int64_t> strides(header.shape.size());
+    std::int64_t stride = 1;
+    for (std::size_t i = 0; i < header.shape.size(); ++i)
+    {
+        const auto d = header.fortran_order ? i : header.shape.size() - 1 - i;
+        strides[d] = stride;
+        stride *= header.shape[d];
+    }
+
+    auto tensor = torch::from_blob(data, header.shape, strides, [owner](void*) mutable { owner.reset(); },
+                                   torch::TensorOptions().dtype(header.dtype));
+    if (header.big_endian)
+    {
+        auto swapped = tensor.clone(torch::MemoryFormat::Contiguous);
+        auto* bytes = static_cast<std::uint8_t*>(swapped.data_ptr());
+        for (std::int64_t i = 0; i < numel; ++i)
+        {
+            std::reverse(bytes + i * element_size, bytes + (i + 1) * element_size);
+        }
+        return swapped;
+    }
+    if (reinterpret_cast<std::uintptr_t>(data) % element_size != 0)
+    {
+        return tensor.clone();
+    }
+    return tensor;
+}
+
+inline torch::Tensor load_npy(const std::string& path)
+{
+    auto file = std::make_shared<MappedFile>(path);
+    try
+    {
+        const auto header = parse_npy_header(file->data(), file->size());
+        return npy_tensor(header, file->data() + header.data_offset, file->size() - header.data_offset, file);
+    }
+    catch (const std::invalid_argument& error)
+    {
+        throw std::invalid_argument("load_npy(" + path + "): " + error.what());
+    }
+}
+
+// Loads every array of a .npz archive, keyed by name without the ".npy" suffix. Stored members are mapped in
+// place; deflated members are inflated into their own buffers, in parallel across members.
+inline std::map<std::string, torch::Tensor> load_npz(const std::string& path)
+{
+    using namespace npy_detail;
+    auto file = std::make_shared<MappedFile>(path);
+    const auto* data = file->data();
+    const auto size = file->size();
+    const auto fail = [&](const std::string& message) { return std::invalid_argument("load_npz(" + path + "): " + message); };
+
+    // End of central directory record: the last 22 bytes, or earlier when the archive has a comment.
+    std::size_t eocd = std::string::npos;
+    if (size >= 22)
+    {
+        const std::size_t lowest = size - 22 > 0xFFFF ? size - 22 - 0xFFFF : 0;
+        for (std::size_t position = size - 22 + 1; position-- > lowest;)
+        {
+            if (read_u32(data + position) == 0x06054b50)
+            {
+                eocd = position;
+                break;
+            }
+        }
+    }
+    if (eocd == std::string::npos)
+    {
+        throw fail("not a zip archive.");
+    }
+
+    std::uint64_t num_entries = read_u16(data + eocd + 10);
+    std::uint64_t directory_offset = read_u32(data + eocd + 16);
+    if ((num_entries == 0xFFFF || directory_offset == 0xFFFFFFFF) && eocd >= 20 && read_u32(data + eocd - 20) == 0x07064b50)
+    {
+        const auto zip64_eocd = read_u64(data + eocd - 12);
+        if (zip64_eocd > size || size - zip64_eocd < 56 || read_u32(data + zip64_eocd) != 0x06064b50)
+        {
+            throw fail("corrupt zip64 end of central directory.");
+        }
+        num_entries = read_u64(data + zip64_eocd + 32);
+        directory_offset = read_u64(data + zip64_eocd + 48);
+    }
+
+    struct Member
+    {
+        std::string name;
+        int method;
+        std::uint64_t compressed_size;
+        std::uint64_t uncompressed_size;
+        std::uint64_t data_offset;
+    };
+    std::vector<Member> members;
+    std::size_t position = directory_offset;
+    for (std::uint64_t i = 0; i < num_entries; ++i)
+    {
+        if (position > size || size - position < 46 || read_u32(data + position) != 0x02014b50)
+        {
+            throw fail("corrupt central directory.");
+        }
+        Member member;
+        member.method = read_u16(data + position + 10);
+        member.compressed_size = read_u32(data + position + 20);
+        member.uncompressed_size = read_u32(data + position + 24);
+        const auto name_length = read_u16(data + position + 28);
+        const auto extra_length = read_u16(data + position + 30);
+        const auto comment_length = read_u16(data + position + 32);
+        std::uint64_t local_offset = read_u32(data + position + 42);
+        if (size - position - 46 < static_cast<std::size_t>(name_length) + extra_length + comment_length)
+        {
+            throw fail("corrupt central directory.");
+        }
+        member.name.assign(reinterpret_cast<const char*>(data + position + 46), name_length);
+
+        // Zip64 extended information replaces exactly the fields that are saturated, in this order.
+        const auto* extra = data + position + 46 + name_length;
+        for (std::size_t e = 0; e + 4 <= extra_length;)
+        {
+            const auto id = read_u16(extra + e);
+            const auto length = read_u16(extra + e + 2);
+            if (e + 4 + length > extra_length)
+            {
+                throw fail("corrupt extra field of " + member.name + ".");
+            }
+            if (id == 0x0001)
+            {
+                // Every saturated field must be present in the record.
+                const std::size_t saturated = (member.uncompressed_size == 0xFFFFFFFF) + (member.compressed_size == 0xFFFFFFFF)
+                                              + (local_offset == 0xFFFFFFFF);
+                if (8 * saturated > length)
+                {
+                    throw fail("corrupt zip64 extra field of " + member.name + ".");
+                }
+                std::size_t field = e + 4;
+                if (member.uncompressed_size == 0xFFFFFFFF)
+                {
+                    member.uncompressed_size = read_u64(extra + field);
+                    field += 8;
+                }
+                if (member.compressed_size == 0xFFFFFFFF)
+                {
+                    member.compressed_size = read_u64(extra + field);
+                    field += 8;
+                }
+                if (local_offset == 0xFFFFFFFF)
+                {
+                    local_offset = read_u64(extra + field);
+                }
+            }
+            e += 4 + length;
+        }
+
+        if (local_offset > size || size - local_offset < 30 || read_u32(data + local_offset) != 0x04034b50)
+        {
+            throw fail("corrupt local header of " + member.name + ".");
+        }
+        member.data_offset = local_offset + 30 + read_u16(data + local_offset + 26) + read_u16(data + local_offset + 28);
+        if (member.data_offset > size || member.compressed_size > size - member.data_offset)
+        {
+            throw fail(member.name + " is truncated.");
+        }
+        if (member.method != 0 && member.method != 8)
+        {
+            throw fail(member.name + " uses an unsupported compression method.");
+        }
+        members.push_back(member);
+        position += 46 + name_length + extra_length + comment_length;
+    }
+
+    std::vector<torch::Tensor> tensors(members.size());
+    std::vector<std::string> errors(members.size());
+    at::parallel_for(0, static_cast<std::int64_t>(members.size()), 1, [&](std::int64_t begin, std::int64_t end)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            const auto& member = members[i];
+            try
+            {
+                if (member.method == 0)
+                {
+                    auto* start = file->data() + member.data_offset;
+                    const auto header = parse_npy_header(start, member.compressed_size);
+                    tensors[i] = npy_tensor(header, start + header.data_offset, member.compressed_size - header.data_offset, file);
+                    continue;
+                }
+
+                auto buffer = std::shared_ptr<std::uint8_t[]>(new std::uint8_t[member.uncompressed_size]);
+                z_stream stream;
+                std::memset(&stream, 0, sizeof(stream));
+                if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+                {
+                    throw std::runtime_error("inflateInit2 failed.");
+                }
+                // zlib counts in uInt, so members larger than 4 GiB are inflated in chunks.
+                std::uint64_t consumed = 0;
+                std::uint64_t produced = 0;
+                int status = Z_OK;
+                while (status == Z_OK)
+                {
+                    stream.next_in = const_cast<Bytef*>(file->data() + member.data_offset + consumed);
+                    stream.avail_in = static_cast<uInt>(std::min<std::uint64_t>(member.compressed_size - consumed, 1u << 30));
+                    stream.next_out = buffer.get() + produced;
+                    stream.avail_out = static_cast<uInt>(std::min<std::uint64_t>(member.uncompressed_size - produced, 1u << 30));
+                    const auto in_before = stream.avail_in;
+                    const auto out_before = stream.avail_out;
+                    status = inflate(&stream, Z_NO_FLUSH);
+                    consumed += in_before - stream.avail_in;
+                    produced += out_before - stream.avail_out;
+                    if (status == Z_OK && in_before == stream.avail_in && out_before == stream.avail_out)
+                    {
+                        status = Z_DATA_ERROR;
+                    }
+                }
+                inflateEnd(&stream);
+                if (status != Z_STREAM_END || produced != member.uncompressed_size)
+                {
+                    throw std::runtime_error("corrupt deflate stream.");
+                }
+
+                const auto header = parse_npy_header(buffer.get(), member.uncompressed_size);
+                tensors[i] = npy_tensor(header, buffer.get() + header.data_offset, member.uncompressed_size - header.data_offset, buffer);
+            }
+            catch (const std::exception& error)
+            {
+                errors[i] = member.name + ": " + error.what();
+            }
+        }
+    });
+
+    std::map<std::string, torch::Tensor> arrays;
+    for (std::size_t i = 0; i < members.size(); ++i)
+    {
+        if (!errors[i].empty())
+        {
+            throw fail(errors[i]);
+        }
+        auto name = members[i].name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".npy") == 0)
+        {
+            name.resize(name.size() - 4);
+        }
+        arrays[name] = tensors[i];
+    }
+    return arrays;
+}
+
+namespace npy_detail
+{
+    // Array `name` of an archive, converted (and so copied) only if it is not of type dtype.
+    inline torch::Tensor get_array(const std::map<std::string, torch::Tensor>& arrays, const std::string& name,
+                                   const torch::ScalarType dtype, const bool required, const std::string& origin)
+    {
+        auto it = arrays.find(name);
+        if (it == arrays.end())
+        {
+            if (required)
+            {
+                throw std::invalid_argument(origin + ": missing array " + name + ".");
+            }
+            return torch::Tensor();
+        }
+        return it->second.scalar_type() == dtype ? it->second : it->second.to(dtype);
+    }
+}
+
+// A graph stored as an .npz archive with arrays named like the Graph members (edge_labels optional). Index
+// arrays of another integer type and attributes that are not float32 are converted, which copies them.
+inline Graph load_npz_graph(const std::string& path)
+{
+    const auto arrays = load_npz(path);
+    const auto origin = "load_npz_graph(" + path + ")";
+    const auto get = [&](const std::string& name, const torch::ScalarType dtype, const bool required)
+    {
+        return npy_detail::get_array(arrays, name, dtype, required, origin);
+    };
+
+    Graph graph;
+    graph.edge_index = get("edge_index", torch::kLong, true);
+    graph.node_attr = get("node_attr", torch::kFloat, true);
+    graph.edge_attr = get("edge_attr", torch::kFloat, true);
+    graph.edge_weight = get("edge_weight", torch::kFloat, true);
+    graph.edge_labels = get("edge_labels", torch::kFloat, false);
+    validate_graph(graph, "load_npz_graph(" + path + ")");
+    return graph;
+}
+
+// A whole packed dataset: the Graph member arrays of all graphs concatenated, with per-graph edge indices, plus
+// node_offsets and edge_offsets (one entry per graph and the totals), as PackedGraphDataset stores it.
+inline PackedGraphDataset load_npz_dataset(const std::string& path)
+{
+    const auto arrays = load_npz(path);
+    const auto origin = "load_npz_dataset(" + path + ")";
+    const auto get = [&](const std::string& name, const torch::ScalarType dtype, const bool required)
+    {
+        return npy_detail::get_array(arrays, name, dtype, required, origin);
+    };
+
+    return PackedGraphDataset::from_buffers(get("node_attr", torch::kFloat, true), get("edge_index", torch::kLong, true),
+                                            get("edge_attr", torch::kFloat, true), get("edge_weight", torch::kFloat, true),
+                                            get("edge_labels", torch::kFloat, false), get("node_offsets", torch::kLong, true),
+                                            get("edge_offsets", torch::kLong, true));
+}
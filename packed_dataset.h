@@ -0,0 +1,205 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+
+// Whole dataset in five contiguous buffers (CSR of graphs): the nodes of graph i are rows
+// [node_offsets[i], node_offsets[i + 1]) of node_attr, its edges columns [edge_offsets[i], edge_offsets[i + 1])
+// of edge_index and rows of edge_attr, edge_weight and edge_labels. Edge indices are stored relative to the
+// graph's first node, so graph(i) is a set of narrow() views that share the buffers and copy no data.
+class PackedGraphDataset
+{
+public:
+    PackedGraphDataset() = default;
+
+    // Copies the graphs into freshly allocated buffers; the input graphs can be released afterwards.
+    static PackedGraphDataset pack(const std::vector<Graph>& graphs)
+    {
+        PackedGraphDataset dataset;
+        if (graphs.empty())
+        {
+            return dataset;
+        }
+
+        const auto& first = graphs.front();
+        bool labelled = true;
+        dataset.node_offsets.push_back(0);
+        dataset.edge_offsets.push_back(0);
+        for (std::size_t i = 0; i < graphs.size(); ++i)
+        {
+            const auto& graph = graphs[i];
+            validate_graph(graph, "PackedGraphDataset::pack: graph " + std::to_string(i));
+            if (graph.node_attr.size(1) != first.node_attr.size(1) || graph.edge_attr.size(1) != first.edge_attr.size(1))
+            {
+                throw std::invalid_argument("PackedGraphDataset::pack: all graphs must have the same attribute sizes.");
+            }
+            labelled = labelled && graph.edge_labels.defined();
+            dataset.node_offsets.push_back(dataset.node_offsets.back() + graph.node_attr.size(0));
+            dataset.edge_offsets.push_back(dataset.edge_offsets.back() + graph.edge_index.size(1));
+        }
+
+        const auto num_nodes = dataset.node_offsets.back();
+        const auto num_edges = dataset.edge_offsets.back();
+        dataset.node_attr = torch::empty({num_nodes, first.node_attr.size(1)}, first.node_attr.options());
+        dataset.edge_index = torch::empty({2, num_edges}, torch::kLong);
+        dataset.edge_attr = torch::empty({num_edges, first.edge_attr.size(1)}, first.edge_attr.options());
+        dataset.edge_weight = torch::empty({num_edges, first.edge_weight.size(1)}, first.edge_weight.options());
+        if (labelled)
+        {
+            dataset.edge_labels = torch::empty({num_edges, first.edge_labels.size(1)}, first.edge_labels.options());
+        }
+
+        for (std::size_t i = 0; i < graphs.size(); ++i)
+        {
+            auto view = dataset.graph(static_cast<std::int64_t>(i));
+            view.node_attr.copy_(graphs[i].node_attr);
+            view.edge_index.copy_(graphs[i].edge_index);
+            view.edge_attr.copy_(graphs[i].edge_attr);
+            view.edge_weight.copy_(graphs[i].edge_weight);
+            if (labelled)
+            {
+                view.edge_labels.copy_(graphs[i].edge_labels);
+            }
+        }
+        return dataset;
+    }
+
+    // Adopts existing buffers (e.g. memory-mapped arrays) without copying them. Offsets hold one entry per graph
+    // plus the totals; edge indices must be relative to each graph's first node.
+    static PackedGraphDataset from_buffers(torch::Tensor node_attr, torch::Tensor edge_index, torch::Tensor edge_attr,
+                                           torch::Tensor edge_weight, torch::Tensor edge_labels,
+                                           torch::Tensor node_offsets, torch::Tensor edge_offsets)
+    {
+        node_offsets = node_offsets.to(torch::kLong).contiguous();
+        edge_offsets = edge_offsets.to(torch::kLong).contiguous();
+        if (node_offsets.dim() != 1 || node_offsets.size(0) < 1 || node_offsets.sizes() != edge_offsets.sizes())
+        {
+            throw std::invalid_argument("PackedGraphDataset::from_buffers: node_offsets and edge_offsets must be vectors of equal length.");
+        }
+
+        PackedGraphDataset dataset;
+        const auto* nodes = node_offsets.data_ptr<std::int64_t>();
+        const auto* edges = edge_offsets.data_ptr<std::int64_t>();
+        dataset.node_offsets.assign(nodes, nodes + node_offsets.size(0));
+        dataset.edge_offsets.assign(edges, edges + edge_offsets.size(0));
+        if (dataset.node_offsets.front() != 0 || dataset.edge_offsets.front() != 0
+            || !std::is_sorted(dataset.node_offsets.begin(), dataset.node_offsets.end())
+            || !std::is_sorted(dataset.edge_offsets.begin(), dataset.edge_offsets.end()))
+        {
+            throw std::invalid_argument("PackedGraphDataset::from_buffers: offsets must start at zero and be non-decreasing.");
+        }
+
+        validate_graph(Graph{edge_index, node_attr, edge_attr, edge_weight, edge_labels}, "PackedGraphDataset::from_buffers");
+        if (node_attr.size(0) != dataset.node_offsets.back() || edge_index.size(1) != dataset.edge_offsets.back())
+        {
+            throw std::invalid_argument("PackedGraphDataset::from_buffers: the last offsets must equal the node and edge counts.");
+        }
+
+        dataset.node_attr = node_attr;
+        dataset.edge_index = edge_index;
+        dataset.edge_attr = edge_attr;
+        dataset.edge_weight = edge_weight;
+        dataset.edge_labels = edge_labels;
+        return dataset;
+    }
+
+    std::int64_t size() const
+    {
+        return static_cast<std::int64_t>(node_offsets.empty() ? 0 : node_offsets.size() - 1);
+    }
+
+    std::int64_t num_nodes(const std::int64_t i) const
+    {
+        return node_offsets[i + 1] - node_offsets[i];
+    }
+
+    std::int64_t num_edges(const std::int64_t i) const
+    {
+        return edge_offsets[i + 1] - edge_offsets[i];
+    }
+
+    // Views of graph i into the packed buffers.
+    Graph graph(const std::int64_t i) const
+    {
+        if (i < 0 || i >= size())
+        {
+            throw std::out_of_range("PackedGraphDataset::graph: index out of range.");
+        }
+
+        const auto first_edge = edge_offsets[i];
+        const auto edges = num_edges(i);
+        Graph view;
+        view.node_attr = node_attr.narrow(0, node_offsets[i], num_nodes(i));
+        view.edge_index = edge_index.narrow(1, first_edge, edges);
+        view.edge_attr = edge_attr.narrow(0, first_edge, edges);
+        view.edge_weight = edge_weight.narrow(0, first_edge, edges);
+        if (edge_labels.defined())
+        {
+            view.edge_labels = edge_labels.narrow(0, first_edge, edges);
+        }
+        return view;
+    }
+
+    // Disjoint union of graphs [begin, end): node and edge tensors are views, only the edge indices are shifted
+    // by their graph's node offset within the batch.
+    GraphBatch batch(const std::int64_t begin, const std::int64_t end) const
+    {
+        if (begin < 0 || end > size() || begin >= end)
+        {
+            throw std::out_of_range("PackedGraphDataset::batch: invalid graph range.");
+        }
+
+        GraphBatch batch;
+        const auto first_node = node_offsets[begin];
+        const auto first_edge = edge_offsets[begin];
+        const auto nodes = node_offsets[end] - first_node;
+        const auto edges = edge_offsets[end] - first_edge;
+        for (auto i = begin; i <= end; ++i)
+        {
+            batch.node_offsets.push_back(node_offsets[i] - first_node);
+            batch.edge_offsets.push_back(edge_offsets[i] - first_edge);
+        }
+
+        const auto num_graphs = end - begin;
+        auto shifts = torch::from_blob(batch.node_offsets.data(), {num_graphs}, torch::kLong);
+        auto batch_edge_offsets = torch::from_blob(batch.edge_offsets.data(), {num_graphs + 1}, torch::kLong);
+        auto counts = batch_edge_offsets.narrow(0, 1, num_graphs) - batch_edge_offsets.narrow(0, 0, num_graphs);
+        batch.graph.edge_index = edge_index.narrow(1, first_edge, edges) + shifts.repeat_interleave(counts, 0, edges);
+        batch.graph.node_attr = node_attr.narrow(0, first_node, nodes);
+        batch.graph.edge_attr = edge_attr.narrow(0, first_edge, edges);
+        batch.graph.edge_weight = edge_weight.narrow(0, first_edge, edges);
+        if (edge_labels.defined())
+        {
+            batch.graph.edge_labels = edge_labels.narrow(0, first_edge, edges);
+        }
+        return batch;
+    }
+
+    std::size_t memory_bytes() const
+    {
+        std::size_t bytes = 0;
+        for (const auto* tensor : {&node_attr, &edge_index, &edge_attr, &edge_weight, &edge_labels})
+        {
+            if (tensor->defined())
+            {
+                bytes += tensor->numel() * tensor->element_size();
+            }
+        }
+        return bytes;
+    }
+
+private:
+    torch::Tensor node_attr;
+    torch::Tensor edge_index;
+    torch::Tensor edge_attr;
+    torch::Tensor edge_weight;
+    torch::Tensor edge_labels;
+    std::vector<std::int64_t> node_offsets;
+    std::vector<std::int64_t> edge_offsets;
+};
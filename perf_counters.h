@@ -0,0 +1,321 @@
+#pragma once
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Regions of the trainer that can be annotated with PerfScope.
+enum class PerfRegion : int
+{
+    message = 0,
+    aggregate,
+    mlp,
+    optimizer,
+    count
+};
+
+inline const char* perf_region_name(const PerfRegion region)
+{
+    static const char* names[] = {"message", "aggregate", "mlp", "optimizer"};
+    return names[static_cast<int>(region)];
+}
+
+// Hardware counters per annotated region, collected with perf_event_open. enable() opens one counter group per
+// thread that exists at that moment (call it after the intra-op pool has started), so regions account the work
+// of all those threads, not only the caller's. Each region boundary reads every group, which costs a few
+// microseconds; profiling is opt-in for that reason. When perf events are unavailable (no kernel support,
+// perf_event_paranoid, seccomp in containers) enable() returns false and PerfScope does nothing; events the
+// CPU does not support are left out and reported as unavailable.
+class PerfCounters
+{
+public:
+    enum Event : int
+    {
+        cycles = 0,
+        instructions,
+        cache_references,
+        cache_misses,
+        llc_read_misses,
+        num_events
+    };
+
+    static PerfCounters& instance()
+    {
+        static PerfCounters counters;
+        return counters;
+    }
+
+    bool enable()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (enabled.load())
+        {
+            return true;
+        }
+
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator("/proc/self/task", error))
+        {
+            const auto tid = static_cast<pid_t>(std::stol(entry.path().filename().string()));
+            ThreadGroup group;
+            if (open_group(tid, group))
+            {
+                groups.push_back(group);
+            }
+        }
+
+        if (groups.empty())
+        {
+            status = std::string("perf_event_open failed: ") + std::strerror(open_errno);
+            return false;
+        }
+
+        for (auto& group : groups)
+        {
+            ioctl(group.fds[cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(group.fds[cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+        status = "counting on " + std::to_string(groups.size()) + " threads";
+        enabled.store(true);
+        return true;
+    }
+
+    bool is_enabled() const
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    const std::string& status_message() const
+    {
+        return status;
+    }
+
+    struct Snapshot
+    {
+        std::array<double, num_events> values{};
+        std::chrono::steady_clock::time_point time;
+    };
+
+    Snapshot read() const
+    {
+        Snapshot snapshot;
+        for (const auto& group : groups)
+        {
+            // PERF_FORMAT_GROUP layout: nr, time_enabled, time_running, one value per opened event.
+            std::uint64_t buffer[3 + num_events] = {0};
+            if (::read(group.fds[cycles], buffer, sizeof(buffer)) <= 0 || buffer[2] == 0)
+            {
+                continue;
+            }
+
+            // Scale up for time the group was multiplexed off the PMU.
+            const double scale = static_cast<double>(buffer[1]) / static_cast<double>(buffer[2]);
+            int position = 0;
+            for (int event = 0; event < num_events; ++event)
+            {
+                if (group.fds[event] >= 0)
+                {
+                    snapshot.values[event] += scale * static_cast<double>(buffer[3 + position]);
+                    ++position;
+                }
+            }
+        }
+        snapshot.time = std::chrono::steady_clock::now();
+        return snapshot;
+    }
+
+    void add(const PerfRegion region, const Snapshot& begin, const Snapshot& end)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto& totals = regions[static_cast<int>(region)];
+        for (int event = 0; event < num_events; ++event)
+        {
+            totals.values[event] += end.values[event] - begin.values[event];
+        }
+        totals.seconds += std::chrono::duration<double>(end.time - begin.time).count();
+        ++totals.calls;
+    }
+
+    // Prints the totals since the last reset: IPC, cache miss rate and LLC read-miss bandwidth per region.
+    void report(std::ostream& out, const std::string& label)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!enabled.load())
+        {
+            return;
+        }
+
+        for (int region = 0; region < static_cast<int>(PerfRegion::count); ++region)
+        {
+            const auto& totals = regions[region];
+            if (totals.calls == 0)
+            {
+                continue;
+            }
+
+            out << label << "\t" << perf_region_name(static_cast<PerfRegion>(region)) << ":\tcalls:\t" << totals.calls
+                << ";\ttime:\t" << totals.seconds << " s";
+            if (available[cycles] && available[instructions] && totals.values[cycles] > 0.0)
+            {
+                out << ";\tIPC:\t" << totals.values[instructions] / totals.values[cycles];
+            }
+            if (available[cache_references] && available[cache_misses] && totals.values[cache_references] > 0.0)
+            {
+                out << ";\tcache miss rate:\t" << 100.0 * totals.values[cache_misses] / totals.values[cache_references] << " %";
+            }
+            if (available[llc_read_misses] && totals.seconds > 0.0)
+            {
+                out << ";\tLLC read-miss bandwidth:\t" << totals.values[llc_read_misses] * cache_line_bytes / totals.seconds * 1e-9 << " GB/s";
+            }
+            out << '\n';
+        }
+    }
+
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        regions = {};
+    }
+
+    ~PerfCounters()
+    {
+        for (auto& group : groups)
+        {
+            for (auto fd : group.fds)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+private:
+    PerfCounters() = default;
+
+    struct ThreadGroup
+    {
+        std::array<int, num_events> fds{-1, -1, -1, -1, -1};
+    };
+
+    struct RegionTotals
+    {
+        std::array<double, num_events> values{};
+        double seconds = 0.0;
+        std::uint64_t calls = 0;
+    };
+
+    static constexpr double cache_line_bytes = 64.0;
+
+    static perf_event_attr event_attr(const int event)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        switch (event)
+        {
+            case cycles: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+            case instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+            case cache_references: attr.config = PERF_COUNT_HW_CACHE_REFERENCES; break;
+            case cache_misses: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+            default:
+                attr.type = PERF_TYPE_HW_CACHE;
+                attr.config = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+                break;
+        }
+        return attr;
+    }
+
+    bool open_group(const pid_t tid, ThreadGroup& group)
+    {
+        for (int event = 0; event < num_events; ++event)
+        {
+            auto attr = event_attr(event);
+            const int leader = event == cycles ? -1 : group.fds[cycles];
+            if (event == cycles)
+            {
+                attr.disabled = 1;
+                attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            }
+
+            const auto fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, tid, -1, leader, 0));
+            if (fd < 0)
+            {
+                open_errno = errno;
+                if (event == cycles)
+                {
+                    return false;
+                }
+                // A missing member event only removes the figures derived from it from the report.
+                available[event] = false;
+                continue;
+            }
+
+            if (!available[event])
+            {
+                close(fd);
+                continue;
+            }
+            group.fds[event] = fd;
+        }
+        return true;
+    }
+
+    std::mutex mutex;
+    std::atomic<bool> enabled{false};
+    std::string status = "disabled";
+    int open_errno = 0;
+    std::array<bool, num_events> available{true, true, true, true, true};
+    std::vector<ThreadGroup> groups;
+    std::array<RegionTotals, static_cast<int>(PerfRegion::count)> regions{};
+};
+
+// Accounts the hardware counters between construction and destruction to a region. Costs one relaxed load
+// when counting is disabled.
+class PerfScope
+{
+public:
+    explicit PerfScope(const PerfRegion region)
+    {
+        this->region = region;
+        active = PerfCounters::instance().is_enabled();
+        if (active)
+        {
+            begin = PerfCounters::instance().read();
+        }
+    }
+
+    PerfScope(const PerfScope&) = delete;
+    PerfScope& operator=(const PerfScope&) = delete;
+
+    ~PerfScope()
+    {
+        if (active)
+        {
+            auto& counters = PerfCounters::instance();
+            counters.add(region, begin, counters.read());
+        }
+    }
+
+private:
+    PerfRegion region;
+    bool active;
+    PerfCounters::Snapshot begin;
+};
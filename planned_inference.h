@@ -0,0 +1,358 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <c10/core/Allocator.h>
+#include <c10/core/CPUAllocator.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "concurrent_branches.h"
+
+// Ahead-of-time memory planning for inference on fixed shapes. The first forward pass of a shape is recorded:
+// the size, allocation time and release time of every CPU buffer the calling thread allocates. Buffers whose
+// lifetimes do not overlap are then packed into one arena (greedy by size, as static memory planners do), and
+// later passes of the same shape take each buffer from its planned offset instead of the heap.
+struct MemoryPlan
+{
+    static constexpr std::size_t alignment = 64;
+
+    std::vector<std::size_t> sizes;
+    std::vector<std::int64_t> allocated_at;
+    std::vector<std::int64_t> released_at;  // max() for buffers still alive when the recording ended
+    std::vector<std::size_t> offsets;
+    std::size_t arena_bytes = 0;
+    c10::DataPtr arena;
+    std::int64_t clock = 0;
+    bool recording = false;
+    // Buffers allocated during a recording may be released on other threads.
+    std::mutex mutex;
+
+    static std::size_t aligned(const std::size_t bytes)
+    {
+        return (bytes + alignment - 1) / alignment * alignment;
+    }
+
+    // Places the buffers in order of decreasing size at the lowest offset that is free during their lifetime.
+    void finalize(c10::Allocator* allocator)
+    {
+        const auto count = sizes.size();
+        std::vector<std::size_t> order(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) { return sizes[a] > sizes[b]; });
+
+        offsets.assign(count, 0);
+        arena_bytes = 0;
+        std::vector<std::size_t> placed;
+        std::vector<std::pair<std::size_t, std::size_t>> conflicts;
+        for (const auto i : order)
+        {
+            conflicts.clear();
+            for (const auto j : placed)
+            {
+                if (allocated_at[i] < released_at[j] && allocated_at[j] < released_at[i])
+                {
+                    conflicts.push_back({offsets[j], offsets[j] + aligned(sizes[j])});
+                }
+            }
+            std::sort(conflicts.begin(), conflicts.end());
+
+            std::size_t offset = 0;
+            for (const auto& conflict : conflicts)
+            {
+                if (offset + aligned(sizes[i]) <= conflict.first)
+                {
+                    break;
+                }
+                offset = std::max(offset, conflict.second);
+            }
+            offsets[i] = offset;
+            arena_bytes = std::max(arena_bytes, offset + aligned(sizes[i]));
+            placed.push_back(i);
+        }
+        arena = allocator->allocate(arena_bytes);
+    }
+};
+
+// CPU allocator that records or replays a MemoryPlan for the thread that opened a session, and forwards every
+// other allocation to the allocator it replaced. Installed on first use.
+class PlanningAllocator final : public c10::Allocator
+{
+public:
+    enum class Mode
+    {
+        record,
+        replay
+    };
+
+    // Activates a plan on the calling thread for its lifetime.
+    class Session
+    {
+    public:
+        Session(std::shared_ptr<MemoryPlan> plan, const Mode mode)
+        {
+            PlanningAllocator::instance();
+            state().plan = std::move(plan);
+            state().mode = mode;
+            state().next = 0;
+            state().fallback_allocations = 0;
+            if (mode == Mode::record)
+            {
+                std::lock_guard<std::mutex> lock(state().plan->mutex);
+                state().plan->recording = true;
+            }
+        }
+
+        ~Session()
+        {
+            if (state().mode == Mode::record)
+            {
+                std::lock_guard<std::mutex> lock(state().plan->mutex);
+                state().plan->recording = false;
+            }
+            state().plan.reset();
+        }
+
+        // Allocations of a replay that did not follow the plan and came from the heap.
+        std::int64_t fallback_allocations() const
+        {
+            return state().fallback_allocations;
+        }
+
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+    };
+
+    static PlanningAllocator& instance()
+    {
+        static PlanningAllocator allocator;
+        return allocator;
+    }
+
+    c10::Allocator* fallback_allocator() const
+    {
+        return fallback;
+    }
+
+    c10::DataPtr allocate(std::size_t bytes) override
+    {
+        auto& current = state();
+        if (!current.plan || bytes == 0)
+        {
+            return fallback->allocate(bytes);
+        }
+
+        auto& plan = *current.plan;
+        if (current.mode == Mode::record)
+        {
+            std::lock_guard<std::mutex> lock(plan.mutex);
+            auto* block = new RecordedBlock{fallback->allocate(bytes), current.plan, plan.sizes.size()};
+            plan.sizes.push_back(bytes);
+            plan.allocated_at.push_back(plan.clock++);
+            plan.released_at.push_back(std::numeric_limits<std::int64_t>::max());
+            void* data = block->data.get();
+            return {data, block, &release_recorded, c10::Device(c10::DeviceType::CPU)};
+        }
+
+        // The replay must request exactly the recorded sizes in the recorded order; after the first deviation
+        // the rest of the pass is served from the heap, since later offsets could then overlap live buffers.
+        if (current.next < plan.sizes.size() && plan.sizes[current.next] == bytes)
+        {
+            void* data = static_cast<std::uint8_t*>(plan.arena.get()) + plan.offsets[current.next++];
+            return {data, data, &release_planned, c10::Device(c10::DeviceType::CPU)};
+        }
+        current.next = std::numeric_limits<std::size_t>::max();
+        ++current.fallback_allocations;
+        return fallback->allocate(bytes);
+    }
+
+    void copy_data(void* destination, const void* source, std::size_t count) const override
+    {
+        default_copy_data(destination, source, count);
+    }
+
+private:
+    struct RecordedBlock
+    {
+        c10::DataPtr data;
+        std::shared_ptr<MemoryPlan> plan;
+        std::size_t index;
+    };
+
+    struct ThreadState
+    {
+        std::shared_ptr<MemoryPlan> plan;
+        Mode mode = Mode::record;
+        std::size_t next = 0;
+        std::int64_t fallback_allocations = 0;
+    };
+
+    PlanningAllocator()
+    {
+        fallback = c10::GetCPUAllocator();
+        c10::SetCPUAllocator(this, 1);
+    }
+
+    static ThreadState& state()
+    {
+        thread_local ThreadState current;
+        return current;
+    }
+
+    static void release_recorded(void* context)
+    {
+        auto* block = static_cast<RecordedBlock*>(context);
+        {
+            std::lock_guard<std::mutex> lock(block->plan->mutex);
+            if (block->plan->recording)
+            {
+                block->plan->released_at[block->index] = block->plan->clock++;
+            }
+        }
+        delete block;
+    }
+
+    static void release_planned(void*)
+    {
+    }
+
+    c10::Allocator* fallback = nullptr;
+};
+
+struct PlannedInferenceStats
+{
+    std::size_t buckets = 0;
+    std::size_t arena_bytes = 0;
+    std::int64_t planned_allocations = 0;   // buffers per pass served from arenas, summed over buckets
+    std::int64_t fallback_allocations = 0;  // heap allocations of replays that left their plan
+    std::int64_t replays = 0;
+};
+
+// Scores graphs with a memory plan per shape bucket. Graphs are padded to a bucket of power-of-two node and edge
+// counts: padded edges have zero weight and attributes and join a padded node, so the scores of the real edges
+// are unchanged. Each bucket keeps its input, output and arena buffers, so a replayed pass allocates no tensor
+// storage. Runs under InferenceMode with the model's concurrent branches serialized, which keeps the
+// allocation sequence of a pass deterministic. Calls are serialized; a returned tensor stays valid until the
+// next call with the same bucket.
+template <typename Model>
+class PlannedInferenceExecutor
+{
+public:
+    explicit PlannedInferenceExecutor(Model model)
+        : model(std::move(model))
+    {
+        this->model->eval();
+    }
+
+    torch::Tensor score(torch::Tensor edge_index, torch::Tensor node_attr, torch::Tensor edge_attr, torch::Tensor edge_weight)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto num_nodes = node_attr.size(0);
+        const auto num_edges = edge_index.size(1);
+        auto& bucket = bucket_for(num_nodes, num_edges, node_attr, edge_attr, edge_weight);
+
+        bucket.node_attr.narrow(0, 0, num_nodes).copy_(node_attr);
+        bucket.node_attr.narrow(0, num_nodes, bucket.num_nodes - num_nodes).zero_();
+        bucket.edge_index.narrow(1, 0, num_edges).copy_(edge_index);
+        bucket.edge_index.narrow(1, num_edges, bucket.num_edges - num_edges).fill_(bucket.num_nodes - 1);
+        bucket.edge_attr.narrow(0, 0, num_edges).copy_(edge_attr);
+        bucket.edge_attr.narrow(0, num_edges, bucket.num_edges - num_edges).zero_();
+        bucket.edge_weight.narrow(0, 0, num_edges).copy_(edge_weight);
+        bucket.edge_weight.narrow(0, num_edges, bucket.num_edges - num_edges).zero_();
+
+        {
+            torch::InferenceMode inference_mode;
+            SequentialBranchesGuard sequential_branches;
+            PlanningAllocator::Session session(bucket.plan, bucket.planned ? PlanningAllocator::Mode::replay : PlanningAllocator::Mode::record);
+            bucket.scores.copy_(model->forward(bucket.edge_index, bucket.node_attr, bucket.edge_attr, bucket.edge_weight));
+            if (bucket.planned)
+            {
+                ++bucket.replays;
+                fallback_allocations += session.fallback_allocations();
+            }
+        }
+        if (!bucket.planned)
+        {
+            bucket.plan->finalize(PlanningAllocator::instance().fallback_allocator());
+            bucket.planned = true;
+        }
+        return bucket.scores.narrow(0, 0, num_edges);
+    }
+
+    PlannedInferenceStats stats() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        PlannedInferenceStats stats;
+        stats.buckets = buckets.size();
+        stats.fallback_allocations = fallback_allocations;
+        for (const auto& entry : buckets)
+        {
+            stats.arena_bytes += entry.second.plan->arena_bytes;
+            stats.planned_allocations += static_cast<std::int64_t>(entry.second.plan->sizes.size());
+            stats.replays += entry.second.replays;
+        }
+        return stats;
+    }
+
+private:
+    struct Bucket
+    {
+        std::int64_t num_nodes = 0;
+        std::int64_t num_edges = 0;
+        torch::Tensor edge_index;
+        torch::Tensor node_attr;
+        torch::Tensor edge_attr;
+        torch::Tensor edge_weight;
+        torch::Tensor scores;
+        std::shared_ptr<MemoryPlan> plan = std::make_shared<MemoryPlan>();
+        bool planned = false;
+        std::int64_t replays = 0;
+    };
+
+    static std::int64_t bucket_size(const std::int64_t size)
+    {
+        std::int64_t bucket = 1;
+        while (bucket < size)
+        {
+            bucket *= 2;
+        }
+        return bucket;
+    }
+
+    // One more node than the graph has, so padded edges always have a padded node to join.
+    Bucket& bucket_for(const std::int64_t num_nodes, const std::int64_t num_edges,
+                       const torch::Tensor& node_attr, const torch::Tensor& edge_attr, const torch::Tensor& edge_weight)
+    {
+        const auto key = std::make_pair(bucket_size(num_nodes + 1), bucket_size(std::max<std::int64_t>(1, num_edges)));
+        auto it = buckets.find(key);
+        if (it != buckets.end())
+        {
+            return it->second;
+        }
+
+        Bucket bucket;
+        bucket.num_nodes = key.first;
+        bucket.num_edges = key.second;
+        bucket.edge_index = torch::empty({2, bucket.num_edges}, torch::kLong);
+        bucket.node_attr = torch::empty({bucket.num_nodes, node_attr.size(1)}, node_attr.options());
+        bucket.edge_attr = torch::empty({bucket.num_edges, edge_attr.size(1)}, edge_attr.options());
+        bucket.edge_weight = torch::empty({bucket.num_edges, edge_weight.size(1)}, edge_weight.options());
+        bucket.scores = torch::empty({bucket.num_edges, 1}, node_attr.options());
+        return buckets.emplace(key, std::move(bucket)).first->second;
+    }
+
+    Model model;
+    mutable std::mutex mutex;
+    std::map<std::pair<std::int64_t, std::int64_t>, Bucket> buckets;
+    std::int64_t fallback_allocations = 0;
+};
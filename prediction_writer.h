@@ -0,0 +1,210 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <ROOT/REntry.hxx>
+#include <ROOT/RNTupleFillContext.hxx>
+#include <ROOT/RNTupleModel.hxx>
+#include <ROOT/RNTupleParallelWriter.hxx>
+#include <ROOT/RNTupleWriteOptions.hxx>
+#include <ROOT/RVec.hxx>
+
+#include "sinks.h"
+
+// Writes per-edge predictions ("edges" RNTuple: graph, source, target, score, label) and, optionally, node
+// embeddings ("nodes" RNTuple in a second file: graph, node, embedding) through RNTupleParallelWriter.
+// Every Context owns its own fill contexts, so threads filling through separate contexts do not contend
+// until a compressed cluster is committed. Entries are bound directly to the rows of the model output tensors
+// (embeddings through non-owning RVecs), so no row is copied before serialization.
+class PredictionWriter final : public PredictionSink
+{
+public:
+    PredictionWriter(const std::string& edges_filename,
+                     const std::string& nodes_filename = "",
+                     const int compression = 505)
+    {
+        ROOT::RNTupleWriteOptions options;
+        options.SetCompression(compression);
+
+        auto edges_model = ROOT::RNTupleModel::CreateBare();
+        edges_model->MakeField<std::int64_t>("graph");
+        edges_model->MakeField<std::int64_t>("source");
+        edges_model->MakeField<std::int64_t>("target");
+        edges_model->MakeField<float>("score");
+        edges_model->MakeField<float>("label");
+        edges_writer = ROOT::RNTupleParallelWriter::Recreate(std::move(edges_model), "edges", edges_filename, options);
+
+        if (!nodes_filename.empty())
+        {
+            auto nodes_model = ROOT::RNTupleModel::CreateBare();
+            nodes_model->MakeField<std::int64_t>("graph");
+            nodes_model->MakeField<std::int64_t>("node");
+            nodes_model->MakeField<ROOT::RVecF>("embedding");
+            nodes_writer = ROOT::RNTupleParallelWriter::Recreate(std::move(nodes_model), "nodes", nodes_filename, options);
+        }
+    }
+
+    PredictionWriter(const PredictionWriter&) = delete;
+    PredictionWriter& operator=(const PredictionWriter&) = delete;
+
+    bool writes_embeddings() const override
+    {
+        return static_cast<bool>(nodes_writer);
+    }
+
+    // Per-thread filling handle. A Context must only be used by one thread at a time and must be destroyed
+    // before its PredictionWriter; destroying it flushes its pending clusters.
+    class Context final : public PredictionSinkContext
+    {
+    public:
+        explicit Context(PredictionWriter& writer)
+        {
+            edges_context = writer.edges_writer->CreateFillContext();
+            edges_entry = edges_context->CreateEntry();
+            graph_token = edges_entry->GetToken("graph");
+            source_token = edges_entry->GetToken("source");
+            target_token = edges_entry->GetToken("target");
+            score_token = edges_entry->GetToken("score");
+            label_token = edges_entry->GetToken("label");
+
+            if (writer.nodes_writer)
+            {
+                nodes_context = writer.nodes_writer->CreateFillContext();
+                nodes_entry = nodes_context->CreateEntry();
+                node_graph_token = nodes_entry->GetToken("graph");
+                node_token = nodes_entry->GetToken("node");
+                embedding_token = nodes_entry->GetToken("embedding");
+            }
+        }
+
+        // Fills one row per edge of edge_index. edge_labels may be undefined (stored as NaN), output_node_attr is
+        // ignored unless the writer stores embeddings. Tensors are made contiguous CPU tensors if they are not.
+        void fill(std::int64_t graph_id, torch::Tensor edge_index, torch::Tensor scores,
+                  torch::Tensor edge_labels, torch::Tensor output_node_attr) override
+        {
+            fill_edges(graph_id, edge_index, scores, edge_labels, 0, edge_index.size(1));
+            if (nodes_context && output_node_attr.defined())
+            {
+                fill_nodes(graph_id, output_node_attr, 0, output_node_attr.size(0));
+            }
+        }
+
+        void fill_edges(std::int64_t graph_id, torch::Tensor edge_index, torch::Tensor scores, torch::Tensor edge_labels,
+                        const std::int64_t first, const std::int64_t count)
+        {
+            auto edges = edge_index.to(torch::kCPU, torch::kLong).contiguous();
+            auto edge_scores = scores.to(torch::kCPU, torch::kFloat).contiguous();
+            auto labels = edge_labels.defined() ? edge_labels.to(torch::kCPU, torch::kFloat).contiguous() : torch::Tensor();
+            if (edge_scores.numel() != edges.size(1) || (labels.defined() && labels.numel() != edges.size(1)))
+            {
+                throw std::invalid_argument("PredictionWriter::Context::fill_edges: scores and edge_labels must have one value per edge.");
+            }
+
+            const auto num_edges = edges.size(1);
+            const std::int64_t* sources = edges.data_ptr<std::int64_t>();
+            const std::int64_t* targets = sources + num_edges;
+            const float* score_data = edge_scores.data_ptr<float>();
+            const float* label_data = labels.defined() ? labels.data_ptr<float>() : nullptr;
+            float missing_label = std::numeric_limits<float>::quiet_NaN();
+
+            edges_entry->BindRawPtr(graph_token, &graph_id);
+            if (!label_data)
+            {
+                edges_entry->BindRawPtr(label_token, &missing_label);
+            }
+            for (std::int64_t e = first; e < first + count; ++e)
+            {
+                edges_entry->BindRawPtr(source_token, const_cast<std::int64_t*>(sources + e));
+                edges_entry->BindRawPtr(target_token, const_cast<std::int64_t*>(targets + e));
+                edges_entry->BindRawPtr(score_token, const_cast<float*>(score_data + e));
+                if (label_data)
+                {
+                    edges_entry->BindRawPtr(label_token, const_cast<float*>(label_data + e));
+                }
+                edges_context->Fill(*edges_entry);
+            }
+        }
+
+        void fill_nodes(std::int64_t graph_id, torch::Tensor output_node_attr, const std::int64_t first, const std::int64_t count)
+        {
+            if (!nodes_context)
+            {
+                throw std::logic_error("PredictionWriter::Context::fill_nodes: the writer was created without a nodes file.");
+            }
+
+            auto embeddings = output_node_attr.detach().to(torch::kCPU, torch::kFloat).contiguous();
+            const auto embedding_size = embeddings.size(1);
+            float* data = embeddings.data_ptr<float>();
+
+            nodes_entry->BindRawPtr(node_graph_token, &graph_id);
+            for (std::int64_t node = first; node < first + count; ++node)
+            {
+                ROOT::RVecF embedding(data + node * embedding_size, static_cast<std::size_t>(embedding_size));
+                nodes_entry->BindRawPtr(node_token, &node);
+                nodes_entry->BindRawPtr(embedding_token, &embedding);
+                nodes_context->Fill(*nodes_entry);
+            }
+        }
+
+    private:
+        std::shared_ptr<ROOT::RNTupleFillContext> edges_context;
+        std::unique_ptr<ROOT::REntry> edges_entry;
+        ROOT::REntry::RFieldToken graph_token, source_token, target_token, score_token, label_token;
+        std::shared_ptr<ROOT::RNTupleFillContext> nodes_context;
+        std::unique_ptr<ROOT::REntry> nodes_entry;
+        ROOT::REntry::RFieldToken node_graph_token, node_token, embedding_token;
+    };
+
+    std::unique_ptr<PredictionSinkContext> make_context() override
+    {
+        return std::make_unique<Context>(*this);
+    }
+
+    // Fills a large graph from all intra-op threads, each through its own context. Calls are serialized because
+    // the per-thread contexts are shared between calls.
+    void fill_parallel(const std::int64_t graph_id, torch::Tensor edge_index, torch::Tensor scores,
+                       torch::Tensor edge_labels, torch::Tensor output_node_attr) override
+    {
+        std::lock_guard<std::mutex> lock(parallel_mutex);
+        while (static_cast<int>(parallel_contexts.size()) < at::get_num_threads())
+        {
+            parallel_contexts.push_back(std::make_unique<Context>(*this));
+        }
+
+        edge_index = edge_index.to(torch::kCPU, torch::kLong).contiguous();
+        scores = scores.to(torch::kCPU, torch::kFloat).contiguous();
+        if (edge_labels.defined())
+        {
+            edge_labels = edge_labels.to(torch::kCPU, torch::kFloat).contiguous();
+        }
+        at::parallel_for(0, edge_index.size(1), 1 << 14, [&](int64_t begin, int64_t end)
+        {
+            parallel_contexts[at::get_thread_num()]->fill_edges(graph_id, edge_index, scores, edge_labels, begin, end - begin);
+        });
+
+        if (nodes_writer && output_node_attr.defined())
+        {
+            output_node_attr = output_node_attr.detach().to(torch::kCPU, torch::kFloat).contiguous();
+            at::parallel_for(0, output_node_attr.size(0), 1 << 12, [&](int64_t begin, int64_t end)
+            {
+                parallel_contexts[at::get_thread_num()]->fill_nodes(graph_id, output_node_attr, begin, end - begin);
+            });
+        }
+    }
+
+private:
+    // Declared before the contexts so the writers outlive them; contexts handed out by make_context() must be
+    // destroyed by their owners before the writer.
+    std::unique_ptr<ROOT::RNTupleParallelWriter> edges_writer;
+    std::unique_ptr<ROOT::RNTupleParallelWriter> nodes_writer;
+    std::mutex parallel_mutex;
+    std::vector<std::unique_ptr<Context>> parallel_contexts;
+};
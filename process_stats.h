@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+// Reads a "<key>: <value> kB" line of /proc/self/status (e.g. VmRSS, VmHWM); returns 0 where unavailable.
+inline std::size_t process_status_bytes(const std::string& key)
+{
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+    {
+        if (line.compare(0, key.size() + 1, key + ":") == 0)
+        {
+            return std::stoul(line.substr(key.size() + 1)) * 1024;
+        }
+    }
+    return 0;
+}
+
+inline std::size_t resident_set_size_bytes()
+{
+    return process_status_bytes("VmRSS");
+}
+
+inline std::size_t peak_resident_set_size_bytes()
+{
+    return process_status_bytes("VmHWM");
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TTree.h"
+#include "TCanvas.h"
+#include "TGraph.h"
+#include "TAxis.h"
+
+#include "concurrent_queue.h"
+#include "sinks.h"
+
+// Appends training metrics to a TTree ("metrics", one entry per record) on a dedicated writer thread.
+// record() only enqueues into a lock-free queue and never waits: when the writer falls behind and the queue is
+// full, records are dropped and counted. The tree is AutoSaved periodically so a running job can be inspected;
+// on close the epoch loss curve is also written as a canvas.
+class RootMetricsSink final : public MetricsSink
+{
+public:
+    RootMetricsSink(const std::string& filename,
+                    const std::chrono::milliseconds autosave_interval = std::chrono::seconds(10),
+                    const std::size_t queue_capacity = 1 << 16)
+        : queue(queue_capacity)
+    {
+        // The writer thread does all ROOT I/O; thread-safety mode makes gDirectory and friends thread-local.
+        ROOT::EnableThreadSafety();
+        this->filename = filename;
+        this->autosave_interval = autosave_interval;
+        writer = std::thread([this]() { run(); });
+    }
+
+    RootMetricsSink(const RootMetricsSink&) = delete;
+    RootMetricsSink& operator=(const RootMetricsSink&) = delete;
+
+    ~RootMetricsSink() override
+    {
+        stop();
+    }
+
+    bool record(MetricsRecord record) override
+    {
+        if (queue.try_push(record))
+        {
+            return true;
+        }
+        ++dropped_records;
+        return false;
+    }
+
+    // Drains the queue, writes the final tree and loss curve and closes the file.
+    void close() override
+    {
+        stop();
+        if (!error.empty())
+        {
+            std::string message = error;
+            error.clear();
+            throw std::runtime_error(message);
+        }
+    }
+
+    std::uint64_t dropped() const override
+    {
+        return dropped_records.load();
+    }
+
+private:
+    void stop()
+    {
+        if (!queue.is_closed())
+        {
+            queue.close();
+            writer.join();
+        }
+    }
+
+    void run()
+    {
+        std::unique_ptr<TFile> file(TFile::Open(filename.c_str(), "RECREATE"));
+        if (!file || file->IsZombie())
+        {
+            error = "RootMetricsSink: cannot open " + filename + " for writing.";
+            MetricsRecord discarded;
+            while (queue.pop(discarded))
+            {
+            }
+            return;
+        }
+
+        MetricsRecord current;
+        auto tree = new TTree("metrics", "Training metrics");  // owned by file
+        tree->Branch("kind", &current.kind, "kind/I");
+        tree->Branch("epoch", &current.epoch, "epoch/I");
+        tree->Branch("step", &current.step_index, "step/L");
+        tree->Branch("loss", &current.loss, "loss/F");
+        tree->Branch("metric", &current.metric, "metric/F");
+        tree->Branch("lr", &current.lr, "lr/F");
+        tree->Branch("step_time", &current.step_time, "step_time/D");
+        tree->Branch("throughput", &current.throughput, "throughput/D");
+
+        std::vector<double> epochs;
+        std::vector<double> epoch_losses;
+        auto last_autosave = std::chrono::steady_clock::now();
+        bool pending = false;
+        for (;;)
+        {
+            // Checked before draining: record() is not called after close(), so once the queue is closed the
+            // drain below sees every record.
+            const bool closed = queue.is_closed();
+            while (queue.try_pop(current))
+            {
+                tree->Fill();
+                pending = true;
+                if (current.kind == MetricsRecord::epoch)
+                {
+                    epochs.push_back(current.epoch);
+                    epoch_losses.push_back(current.loss);
+                }
+            }
+
+            if (closed)
+            {
+                break;
+            }
+
+            const auto now = std::chrono::steady_clock::now();
+            if (pending && now - last_autosave >= autosave_interval)
+            {
+                tree->AutoSave("SaveSelf");
+                last_autosave = now;
+                pending = false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+
+        file->cd();
+        tree->Write("", TObject::kOverwrite);
+
+        if (!epochs.empty())
+        {
+            gROOT->SetBatch(kTRUE);
+            TGraph graph(static_cast<int>(epochs.size()), epochs.data(), epoch_losses.data());
+            graph.GetXaxis()->SetTitle("Epoch number");
+            graph.GetYaxis()->SetTitle("Loss");
+            TCanvas canvas("Training_dynamics", "Training_dynamics", 0, 0, 700, 500);
+            graph.Draw("AL");
+            canvas.Write("Training_dynamics", TObject::kOverwrite);
+        }
+        file->Close();
+    }
+
+    std::string filename;
+    std::chrono::milliseconds autosave_interval;
+    ConcurrentQueue<MetricsRecord> queue;
+    std::atomic<std::uint64_t> dropped_records{0};
+    std::string error;
+    std::thread writer;
+};
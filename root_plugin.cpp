@@ -0,0 +1,28 @@
+// ROOT-dependent sinks, built as a module that the executables dlopen only when a ROOT output is configured,
+// so processes that do not write ROOT files neither link nor initialize ROOT.
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sinks.h"
+#include "root_metrics.h"
+#include "prediction_writer.h"
+#include "scaling_plots.h"
+
+extern "C" MetricsSink* create_root_metrics_sink(const char* filename, const long autosave_interval_ms)
+{
+    return new RootMetricsSink(filename, std::chrono::milliseconds(autosave_interval_ms));
+}
+
+extern "C" PredictionSink* create_root_prediction_sink(const char* edges_filename, const char* nodes_filename,
+                                                       const int compression)
+{
+    return new PredictionWriter(edges_filename, nodes_filename, compression);
+}
+
+extern "C" bool write_root_scaling_plots(const char* filename, const ScalingCurve* curves, const std::size_t num_curves)
+{
+    return write_scaling_plots(filename, std::vector<ScalingCurve>(curves, curves + num_curves));
+}
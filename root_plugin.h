@@ -0,0 +1,87 @@
+#pragma once
+
+#include <dlfcn.h>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sinks.h"
+
+#ifndef ROOT_PLUGIN_PATH
+#define ROOT_PLUGIN_PATH "libroot_plugin.so"
+#endif
+
+// Loads the root_plugin module on first use. The module path can be overridden with the ROOT_PLUGIN environment
+// variable. The module is never unloaded: ROOT registers global state that must outlive the process's last use.
+class RootPlugin
+{
+public:
+    static RootPlugin& instance()
+    {
+        static RootPlugin plugin;
+        return plugin;
+    }
+
+    std::unique_ptr<MetricsSink> make_metrics_sink(const std::string& filename,
+                                                   const std::chrono::milliseconds autosave_interval)
+    {
+        auto create = symbol<MetricsSink* (*)(const char*, long)>("create_root_metrics_sink");
+        return std::unique_ptr<MetricsSink>(create(filename.c_str(), static_cast<long>(autosave_interval.count())));
+    }
+
+    std::unique_ptr<PredictionSink> make_prediction_sink(const std::string& edges_filename,
+                                                         const std::string& nodes_filename = "",
+                                                         const int compression = 505)
+    {
+        auto create = symbol<PredictionSink* (*)(const char*, const char*, int)>("create_root_prediction_sink");
+        return std::unique_ptr<PredictionSink>(create(edges_filename.c_str(), nodes_filename.c_str(), compression));
+    }
+
+    // Writes speedup and efficiency canvases per curve group; throws if the file cannot be written.
+    void write_scaling_plots(const std::string& filename, const std::vector<ScalingCurve>& curves)
+    {
+        auto write = symbol<bool (*)(const char*, const ScalingCurve*, std::size_t)>("write_root_scaling_plots");
+        if (!write(filename.c_str(), curves.data(), curves.size()))
+        {
+            throw std::runtime_error("RootPlugin: cannot write scaling plots to " + filename + ".");
+        }
+    }
+
+    bool is_loaded() const
+    {
+        return handle != nullptr;
+    }
+
+private:
+    RootPlugin() = default;
+
+    template <typename Function>
+    Function symbol(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!handle)
+        {
+            const char* path = std::getenv("ROOT_PLUGIN");
+            path = path ? path : ROOT_PLUGIN_PATH;
+            handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+            if (!handle)
+            {
+                throw std::runtime_error(std::string("RootPlugin: cannot load ") + path + ": " + dlerror());
+            }
+        }
+
+        void* address = dlsym(handle, name);
+        if (!address)
+        {
+            throw std::runtime_error(std::string("RootPlugin: missing symbol ") + name + ".");
+        }
+        return reinterpret_cast<Function>(address);
+    }
+
+    std::mutex mutex;
+    void* handle = nullptr;
+};
@@ -0,0 +1,280 @@
+#include <torch/torch.h>
+#include <yaml-cpp/yaml.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+#include <cstdio>
+
+#include "nn.h"
+#include "graph.h"
+#include "graph_generator.h"
+#include "model_config.h"
+#include "sinks.h"
+#include "root_plugin.h"
+
+// Strong- and weak-scaling study of the trainer. Thread scaling runs in this process with the intra-op thread
+// count set per measurement; process scaling re-executes this binary as independent workers, each training its
+// own model replica (there is no gradient exchange, so it measures how well local processes share the machine).
+// Strong scaling keeps the total work fixed: the graph size for threads, the number of training steps split
+// across processes. Weak scaling keeps the work per worker fixed: graphs grow with the thread count, and every
+// process runs all steps.
+
+struct TrainingTiming
+{
+    std::int64_t start_ns = 0;
+    std::int64_t end_ns = 0;
+
+    double seconds() const
+    {
+        return static_cast<double>(end_ns - start_ns) * 1e-9;
+    }
+};
+
+std::int64_t steady_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Times `steps` training steps after two warm-up steps, on freshly generated graphs and a fresh model.
+TrainingTiming time_training(const YAML::Node& config, const GraphGeneratorOptions& options, const int num_graphs,
+                             const int steps, const int threads)
+{
+    torch::set_num_threads(threads);
+    auto graphs = GraphGenerator(options).generate(num_graphs);
+    torch::manual_seed(0);
+    auto model = make_model(config);
+    torch::optim::Adam opt(model->parameters(), config["lr"].as<float>(1e-4f));
+    torch::nn::MSELoss loss_fn;
+
+    auto step = [&](const int i)
+    {
+        const auto& graph = graphs[i % graphs.size()];
+        loss_fn(model->forward(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight), graph.edge_labels).backward();
+        opt.step();
+        opt.zero_grad();
+    };
+
+    for (int i = 0; i < 2; ++i)
+    {
+        step(i);
+    }
+
+    TrainingTiming timing;
+    timing.start_ns = steady_now_ns();
+    for (int i = 0; i < steps; ++i)
+    {
+        step(i);
+    }
+    timing.end_ns = steady_now_ns();
+    return timing;
+}
+
+GraphGeneratorOptions family_options(const YAML::Node& scaling, const std::string& family, const double mean_nodes)
+{
+    GraphGeneratorOptions options;
+    options.family = family;
+    options.mean_nodes = mean_nodes;
+    options.stddev_nodes = 0.1 * mean_nodes;
+    options.mean_degree = scaling["mean_degree"].as<double>(8.0);
+    return options;
+}
+
+// Runs `count` worker processes concurrently and returns the span from the first worker's start to the last
+// worker's end. steady_clock is CLOCK_MONOTONIC, which is shared by all processes of the machine.
+double time_processes(const std::string& config_path, const std::string& family, const double mean_nodes,
+                      const int steps, const int threads, const int count)
+{
+    struct Worker
+    {
+        pid_t pid;
+        int output;
+    };
+    std::vector<Worker> workers;
+    for (int i = 0; i < count; ++i)
+    {
+        int fds[2];
+        if (pipe(fds) != 0)
+        {
+            throw std::runtime_error("time_processes: pipe failed.");
+        }
+
+        std::vector<std::string> arguments = {"scaling", "--worker", config_path, family, std::to_string(mean_nodes),
+                                              std::to_string(steps), std::to_string(threads), std::to_string(i)};
+        // Built before fork: the child of a multithreaded process must not allocate before exec.
+        std::vector<char*> argv;
+        for (auto& argument : arguments)
+        {
+            argv.push_back(argument.data());
+        }
+        argv.push_back(nullptr);
+
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            throw std::runtime_error("time_processes: fork failed.");
+        }
+        if (pid == 0)
+        {
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[0]);
+            close(fds[1]);
+            execv("/proc/self/exe", argv.data());
+            _exit(127);
+        }
+        close(fds[1]);
+        workers.push_back({pid, fds[0]});
+    }
+
+    std::int64_t first_start = std::numeric_limits<std::int64_t>::max();
+    std::int64_t last_end = 0;
+    bool failed = false;
+    for (const auto& worker : workers)
+    {
+        std::string text;
+        char buffer[256];
+        ssize_t length;
+        while ((length = read(worker.output, buffer, sizeof(buffer))) > 0)
+        {
+            text.append(buffer, static_cast<std::size_t>(length));
+        }
+        close(worker.output);
+
+        int status = 0;
+        waitpid(worker.pid, &status, 0);
+        std::istringstream in(text);
+        TrainingTiming timing;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || !(in >> timing.start_ns >> timing.end_ns))
+        {
+            failed = true;
+            continue;
+        }
+        first_start = std::min(first_start, timing.start_ns);
+        last_end = std::max(last_end, timing.end_ns);
+    }
+
+    if (failed)
+    {
+        throw std::runtime_error("time_processes: a worker process failed.");
+    }
+    return static_cast<double>(last_end - first_start) * 1e-9;
+}
+
+struct ScalingSeries
+{
+    std::string experiment;  // "threads" or "processes"
+    std::string mode;        // "strong" or "weak"
+    std::string family;
+    double size = 0.0;
+    std::vector<double> workers;
+    std::vector<double> seconds;
+};
+
+// Relative to the first worker count, which should be one: strong speedup is w0 * T0 / T, weak (scaled) speedup
+// w * T0 / T; efficiency is speedup per worker in both cases.
+ScalingCurve to_curve(const ScalingSeries& series)
+{
+    ScalingCurve curve;
+    curve.group = series.experiment + "_" + series.mode;
+    curve.name = series.family + " N=" + std::to_string(static_cast<long>(series.size));
+    curve.workers = series.workers;
+    for (std::size_t i = 0; i < series.workers.size(); ++i)
+    {
+        const double ratio = series.seconds[0] / series.seconds[i];
+        const double speedup = series.mode == "strong" ? series.workers[0] * ratio : series.workers[i] * ratio;
+        curve.speedup.push_back(speedup);
+        curve.efficiency.push_back(speedup / series.workers[i]);
+    }
+    return curve;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc == 8 && std::string(argv[1]) == "--worker")
+    {
+        YAML::Node config = YAML::LoadFile(argv[2]);
+        YAML::Node scaling = config["scaling"];
+        auto options = family_options(scaling, argv[3], std::stod(argv[4]));
+        options.seed = std::stoull(argv[7]);
+        auto timing = time_training(config, options, scaling["graphs"].as<int>(20), std::stoi(argv[5]), std::stoi(argv[6]));
+        std::cout << timing.start_ns << ' ' << timing.end_ns << '\n';
+        return 0;
+    }
+
+    if (argc != 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <config.yaml>\n";
+        return 1;
+    }
+
+    YAML::Node config = YAML::LoadFile(argv[1]);
+    YAML::Node scaling = config["scaling"];
+    const auto thread_counts = scaling["threads"].as<std::vector<int>>(std::vector<int>{1, 2, 4, 8});
+    const auto process_counts = scaling["processes"].as<std::vector<int>>(std::vector<int>{1, 2, 4});
+    const int threads_per_process = std::max(1, scaling["threads_per_process"].as<int>(1));
+    const auto families = scaling["families"].as<std::vector<std::string>>(std::vector<std::string>{"erdos_renyi", "geometric", "preferential"});
+    const auto sizes = scaling["sizes"].as<std::vector<double>>(std::vector<double>{30.0, 300.0});
+    const int num_graphs = std::max(1, scaling["graphs"].as<int>(20));
+    const int steps = std::max(1, scaling["steps"].as<int>(40));
+
+    std::vector<ScalingSeries> results;
+    for (const auto& family : families)
+    {
+        for (const auto size : sizes)
+        {
+            for (const std::string mode : {"strong", "weak"})
+            {
+                ScalingSeries threads_series{"threads", mode, family, size};
+                for (const auto threads : thread_counts)
+                {
+                    const double nodes = mode == "strong" ? size : size * threads;
+                    threads_series.workers.push_back(threads);
+                    threads_series.seconds.push_back(time_training(config, family_options(scaling, family, nodes), num_graphs, steps, threads).seconds());
+                }
+                results.push_back(threads_series);
+
+                ScalingSeries processes_series{"processes", mode, family, size};
+                for (const auto processes : process_counts)
+                {
+                    const int worker_steps = mode == "strong" ? std::max(1, steps / processes) : steps;
+                    processes_series.workers.push_back(processes);
+                    processes_series.seconds.push_back(time_processes(argv[1], family, size, worker_steps, threads_per_process, processes));
+                }
+                results.push_back(processes_series);
+            }
+        }
+    }
+
+    std::vector<ScalingCurve> curves;
+    const auto csv_output = scaling["csv_output"].as<std::string>("scaling.csv");
+    std::ofstream csv(csv_output);
+    csv << "experiment,mode,family,size,workers,seconds,speedup,efficiency\n";
+    std::cout << "experiment\tmode\tfamily\tsize\tworkers\tseconds\tspeedup\tefficiency\n";
+    for (const auto& series : results)
+    {
+        curves.push_back(to_curve(series));
+        const auto& curve = curves.back();
+        for (std::size_t i = 0; i < series.workers.size(); ++i)
+        {
+            std::cout << series.experiment << '\t' << series.mode << '\t' << series.family << '\t' << series.size << '\t'
+                      << series.workers[i] << '\t' << series.seconds[i] << '\t' << curve.speedup[i] << '\t' << curve.efficiency[i] << '\n';
+            csv << series.experiment << ',' << series.mode << ',' << series.family << ',' << series.size << ','
+                << series.workers[i] << ',' << series.seconds[i] << ',' << curve.speedup[i] << ',' << curve.efficiency[i] << '\n';
+        }
+    }
+
+    const auto plot_output = scaling["plot_output"].as<std::string>("");
+    if (!plot_output.empty())
+    {
+        RootPlugin::instance().write_scaling_plots(plot_output, curves);
+    }
+    return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TROOT.h"
+#include "TFile.h"
+#include "TCanvas.h"
+#include "TGraph.h"
+#include "TMultiGraph.h"
+#include "TLegend.h"
+#include "TAxis.h"
+
+#include "sinks.h"
+
+// Writes one "<group>_speedup" and one "<group>_efficiency" canvas per curve group, with the ideal speedup
+// (or efficiency of one) drawn dashed for reference. Returns false if the file cannot be opened.
+inline bool write_scaling_plots(const std::string& filename, const std::vector<ScalingCurve>& curves)
+{
+    std::unique_ptr<TFile> file(TFile::Open(filename.c_str(), "RECREATE"));
+    if (!file || file->IsZombie())
+    {
+        return false;
+    }
+    gROOT->SetBatch(kTRUE);
+
+    std::map<std::string, std::vector<const ScalingCurve*>> groups;
+    for (const auto& curve : curves)
+    {
+        groups[curve.group].push_back(&curve);
+    }
+
+    for (const auto& [group, members] : groups)
+    {
+        double max_workers = 1.0;
+        for (const auto* curve : members)
+        {
+            for (auto workers : curve->workers)
+            {
+                max_workers = std::max(max_workers, workers);
+            }
+        }
+
+        for (const bool efficiency : {false, true})
+        {
+            const std::string name = group + (efficiency ? "_efficiency" : "_speedup");
+            TCanvas canvas(name.c_str(), name.c_str(), 0, 0, 700, 500);
+            // The multigraph and legend own the graphs and entries added to them.
+            TMultiGraph graphs;
+            TLegend legend(0.12, 0.65, 0.45, 0.88);
+            int colour = 1;
+            for (const auto* curve : members)
+            {
+                const auto& values = efficiency ? curve->efficiency : curve->speedup;
+                auto graph = new TGraph(static_cast<int>(curve->workers.size()), curve->workers.data(), values.data());
+                graph->SetLineColor(colour);
+                graph->SetMarkerColor(colour);
+                graph->SetMarkerStyle(20);
+                graphs.Add(graph, "LP");
+                legend.AddEntry(graph, curve->name.c_str(), "lp");
+                ++colour;
+            }
+
+            const double ideal_x[] = {1.0, max_workers};
+            const double ideal_y[] = {1.0, efficiency ? 1.0 : max_workers};
+            auto ideal = new TGraph(2, ideal_x, ideal_y);
+            ideal->SetLineStyle(2);
+            graphs.Add(ideal, "L");
+            legend.AddEntry(ideal, "ideal", "l");
+
+            graphs.SetTitle((name + ";Workers;" + (efficiency ? "Parallel efficiency" : "Speedup")).c_str());
+            graphs.Draw("A");
+            legend.Draw();
+            canvas.Write(name.c_str(), TObject::kOverwrite);
+        }
+    }
+    file->Close();
+    return true;
+}
@@ -0,0 +1,478 @@
+#include <torch/torch.h>
+#include <yaml-cpp/yaml.h>
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+
+#include "nn.h"
+#include "graph.h"
+#include "connected_components.h"
+#include "npy_loader.h"
+#include "model_config.h"
+#include "flat_checkpoint.h"
+#include "concurrent_queue.h"
+#include "threading.h"
+#include "sinks.h"
+#include "root_plugin.h"
+
+// Offline batch scoring: reads graph files, scores every edge with a trained model and writes
+// "graph,source,target,score" lines in input order. The stages (readers, batchers, inference workers and the
+// writer) run on their own threads and are connected by bounded lock-free queues, so a slow stage throttles the
+// stages feeding it instead of letting memory grow. Optionally the writer also stores predictions, labels and
+// node embeddings as RNTuples, and the connected components of the edges scoring above a threshold (track
+// candidates) as "graph,node,component" lines.
+
+struct LoadedGraph
+{
+    std::int64_t sequence = 0;
+    Graph graph;
+    std::string error;
+};
+
+struct BatchedGraphs
+{
+    std::vector<std::int64_t> sequences;
+    std::vector<std::string> errors;
+    GraphBatch batch;
+};
+
+struct ScoredGraph
+{
+    std::int64_t sequence = 0;
+    torch::Tensor edge_index;
+    torch::Tensor scores;
+    torch::Tensor edge_labels;
+    torch::Tensor output_node_attr;
+    torch::Tensor components;
+    std::string error;
+};
+
+// Busy time of all threads of a stage; utilization is busy time over the threads' combined wall time.
+class StageMonitor
+{
+public:
+    StageMonitor(std::string name, const int num_threads)
+    {
+        this->name = std::move(name);
+        this->num_threads = num_threads;
+        active_threads.store(num_threads);
+    }
+
+    template <typename Function>
+    auto timed(Function&& function)
+    {
+        auto t0 = std::chrono::steady_clock::now();
+        struct Accumulate
+        {
+            StageMonitor& monitor;
+            std::chrono::steady_clock::time_point t0;
+            ~Accumulate()
+            {
+                monitor.busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+            }
+        } accumulate{*this, t0};
+        ++items;
+        return function();
+    }
+
+    // Returns true for the last thread of the stage to finish, which then closes the stage's output queue.
+    bool finish_thread()
+    {
+        return active_threads.fetch_sub(1) == 1;
+    }
+
+    void report(std::ostream& out, const double wall_seconds) const
+    {
+        const double busy_seconds = static_cast<double>(busy_ns.load()) * 1e-9;
+        out << name << ":\t" << num_threads << " threads;\t" << items.load() << " items;\tutilization:\t"
+            << 100.0 * busy_seconds / (wall_seconds * num_threads) << " %\n";
+    }
+
+private:
+    std::string name;
+    int num_threads;
+    std::atomic<int> active_threads{0};
+    std::atomic<std::int64_t> busy_ns{0};
+    std::atomic<std::int64_t> items{0};
+};
+
+std::vector<std::string> list_inputs(const std::string& input)
+{
+    std::vector<std::string> paths;
+    if (std::filesystem::is_directory(input))
+    {
+        for (const auto& entry : std::filesystem::directory_iterator(input))
+        {
+            if (entry.is_regular_file() && (entry.path().extension() == ".pt" || entry.path().extension() == ".npz"))
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+        return paths;
+    }
+
+    std::ifstream list(input);
+    if (!list)
+    {
+        throw std::invalid_argument("list_inputs: cannot open " + input + ".");
+    }
+    for (std::string line; std::getline(list, line);)
+    {
+        if (!line.empty())
+        {
+            paths.push_back(line);
+        }
+    }
+    return paths;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 5)
+    {
+        std::cerr << "Usage: " << argv[0] << " <config.yaml> <model.pt> <graph directory | list file> <output.csv>\n";
+        return 1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+
+    YAML::Node config = YAML::LoadFile(argv[1]);
+    YAML::Node scoring = config["scoring"];
+    const int num_readers = std::max(1, scoring["readers"].as<int>(2));
+    const int num_batchers = std::max(1, scoring["batchers"].as<int>(1));
+    const int num_workers = std::max(1, scoring["workers"].as<int>(2));
+    const int batch_size = std::max(1, scoring["batch_size"].as<int>(32));
+    const auto queue_capacity = static_cast<std::size_t>(std::max(2, scoring["queue_capacity"].as<int>(256)));
+
+    auto model = make_model(config);
+    // Flat checkpoints are mapped in place and shared with every other process scoring with the same file.
+    if (std::filesystem::path(argv[2]).extension() == ".flat")
+    {
+        load_flat_checkpoint(*model, argv[2]);
+    }
+    else
+    {
+        torch::load(model, argv[2]);
+    }
+    model->eval();
+
+    const auto predictions_output = scoring["predictions_output"].as<std::string>("");
+    const auto embeddings_output = scoring["embeddings_output"].as<std::string>("");
+    std::unique_ptr<PredictionSink> prediction_writer;
+    if (!predictions_output.empty())
+    {
+        prediction_writer = RootPlugin::instance().make_prediction_sink(predictions_output, embeddings_output);
+    }
+    const bool keep_embeddings = prediction_writer && prediction_writer->writes_embeddings();
+
+    const auto components_output_path = scoring["components_output"].as<std::string>("");
+    const auto component_threshold = scoring["component_threshold"].as<double>(0.5);
+    std::ofstream components_output;
+    if (!components_output_path.empty())
+    {
+        components_output.open(components_output_path);
+        if (!components_output)
+        {
+            std::cerr << "Cannot open " << components_output_path << " for writing.\n";
+            return 1;
+        }
+    }
+
+    const auto paths = list_inputs(argv[3]);
+    std::ofstream output(argv[4]);
+    if (!output)
+    {
+        std::cerr << "Cannot open " << argv[4] << " for writing.\n";
+        return 1;
+    }
+
+    ConcurrentQueue<LoadedGraph> loaded_queue(queue_capacity);
+    ConcurrentQueue<BatchedGraphs> batch_queue(std::max<std::size_t>(2, queue_capacity / static_cast<std::size_t>(batch_size)));
+    ConcurrentQueue<ScoredGraph> scored_queue(queue_capacity);
+    StageMonitor reader_monitor("readers", num_readers);
+    StageMonitor batcher_monitor("batchers", num_batchers);
+    StageMonitor worker_monitor("inference", num_workers);
+    StageMonitor writer_monitor("writer", 1);
+
+    std::atomic<std::size_t> next_path{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_readers; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            for (std::size_t index = next_path++; index < paths.size(); index = next_path++)
+            {
+                LoadedGraph loaded;
+                loaded.sequence = static_cast<std::int64_t>(index);
+                reader_monitor.timed([&]()
+                {
+                    try
+                    {
+                        const bool numpy = std::filesystem::path(paths[index]).extension() == ".npz";
+                        loaded.graph = numpy ? load_npz_graph(paths[index]) : load_graph(paths[index]);
+                    }
+                    catch (const std::exception& e)
+                    {
+                        loaded.error = e.what();
+                    }
+                });
+                loaded_queue.push(std::move(loaded));
+            }
+            if (reader_monitor.finish_thread())
+            {
+                loaded_queue.close();
+            }
+        });
+    }
+
+    for (int i = 0; i < num_batchers; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            std::vector<Graph> graphs;
+            BatchedGraphs batched;
+            auto flush = [&]()
+            {
+                if (batched.sequences.empty())
+                {
+                    return;
+                }
+                if (!graphs.empty())
+                {
+                    batcher_monitor.timed([&]()
+                    {
+                        try
+                        {
+                            batched.batch = batch_graphs(graphs);
+                        }
+                        catch (const std::exception& e)
+                        {
+                            // An exception must not escape the thread; the writer reports every graph of the batch.
+                            for (auto& error : batched.errors)
+                            {
+                                if (error.empty())
+                                {
+                                    error = std::string("batching failed: ") + e.what();
+                                }
+                            }
+                            batched.batch = GraphBatch();
+                        }
+                    });
+                }
+                batch_queue.push(std::move(batched));
+                batched = BatchedGraphs();
+                graphs.clear();
+            };
+
+            LoadedGraph loaded;
+            while (loaded_queue.pop(loaded))
+            {
+                batched.sequences.push_back(loaded.sequence);
+                batched.errors.push_back(loaded.error);
+                if (loaded.error.empty())
+                {
+                    graphs.push_back(std::move(loaded.graph));
+                }
+                if (static_cast<int>(batched.sequences.size()) == batch_size)
+                {
+                    flush();
+                }
+            }
+            flush();
+            if (batcher_monitor.finish_thread())
+            {
+                batch_queue.close();
+            }
+        });
+    }
+
+    for (int i = 0; i < num_workers; ++i)
+    {
+        threads.emplace_back([&]()
+        {
+            set_intra_op_threads_for_current_thread(std::max(1, at::get_num_threads() / num_workers));
+            torch::NoGradGuard no_grad;
+            BatchedGraphs batched;
+            while (batch_queue.pop(batched))
+            {
+                std::vector<ScoredGraph> scored(batched.sequences.size());
+                worker_monitor.timed([&]()
+                {
+                    try
+                    {
+                        torch::Tensor scores;
+                        torch::Tensor output_node_attr;
+                        torch::Tensor components;
+                        const auto& graph = batched.batch.graph;
+                        if (graph.edge_index.defined())
+                        {
+                            output_node_attr = model->embed(graph.edge_index, graph.node_attr, graph.edge_attr, graph.edge_weight);
+                            scores = model->readout(graph.edge_index, output_node_attr);
+                            // One pass over the whole batch: components never span two graphs of the disjoint union.
+                            if (components_output.is_open())
+                            {
+                                components = connected_components(graph.edge_index, scores, graph.node_attr.size(0), component_threshold);
+                            }
+                        }
+
+                        size_t graph_index = 0;
+                        for (size_t j = 0; j < scored.size(); ++j)
+                        {
+                            scored[j].sequence = batched.sequences[j];
+                            scored[j].error = batched.errors[j];
+                            if (!scored[j].error.empty())
+                            {
+                                continue;
+                            }
+                            const auto first_edge = batched.batch.edge_offsets[graph_index];
+                            const auto num_edges = batched.batch.edge_offsets[graph_index + 1] - first_edge;
+                            scored[j].edge_index = graph.edge_index.narrow(1, first_edge, num_edges) - batched.batch.node_offsets[graph_index];
+                            scored[j].scores = scores.narrow(0, first_edge, num_edges);
+                            if (graph.edge_labels.defined())
+                            {
+                                scored[j].edge_labels = graph.edge_labels.narrow(0, first_edge, num_edges);
+                            }
+                            const auto first_node = batched.batch.node_offsets[graph_index];
+                            const auto num_nodes = batched.batch.node_offsets[graph_index + 1] - first_node;
+                            if (keep_embeddings)
+                            {
+                                scored[j].output_node_attr = output_node_attr.narrow(0, first_node, num_nodes);
+                            }
+                            if (components.defined())
+                            {
+                                scored[j].components = components.narrow(0, first_node, num_nodes) - first_node;
+                            }
+                            ++graph_index;
+                        }
+                    }
+                    catch (const std::exception& e)
+                    {
+                        // An exception must not escape the thread: every graph of the batch gets an error row, which
+                        // keeps the ordered writer moving.
+                        for (size_t j = 0; j < scored.size(); ++j)
+                        {
+                            scored[j] = ScoredGraph();
+                            scored[j].sequence = batched.sequences[j];
+                            scored[j].error = batched.errors[j].empty() ? std::string("scoring failed: ") + e.what() : batched.errors[j];
+                        }
+                    }
+                });
+                for (auto& item : scored)
+                {
+                    scored_queue.push(std::move(item));
+                }
+            }
+            if (worker_monitor.finish_thread())
+            {
+                scored_queue.close();
+            }
+        });
+    }
+
+    std::int64_t num_failed = 0;
+    std::int64_t num_scored_edges = 0;
+    threads.emplace_back([&]()
+    {
+        // Results arrive out of order; hold them back until every earlier graph has been written.
+        std::map<std::int64_t, ScoredGraph> pending;
+        std::int64_t next_sequence = 0;
+        std::vector<char> line(128);
+        std::unique_ptr<PredictionSinkContext> prediction_context;
+        if (prediction_writer)
+        {
+            prediction_context = prediction_writer->make_context();
+        }
+        output << "graph,source,target,score\n";
+        if (components_output.is_open())
+        {
+            components_output << "graph,node,component\n";
+        }
+
+        ScoredGraph scored;
+        while (scored_queue.pop(scored))
+        {
+            pending.emplace(scored.sequence, std::move(scored));
+            for (auto it = pending.find(next_sequence); it != pending.end(); it = pending.find(++next_sequence))
+            {
+                writer_monitor.timed([&]()
+                {
+                    const auto& item = it->second;
+                    if (!item.error.empty())
+                    {
+                        std::cerr << paths[item.sequence] << ": " << item.error << '\n';
+                        ++num_failed;
+                        return;
+                    }
+
+                    auto edge_index = item.edge_index.contiguous();
+                    auto scores = item.scores.to(torch::kFloat).contiguous();
+                    auto edge_accessor = edge_index.accessor<std::int64_t, 2>();
+                    auto score_accessor = scores.accessor<float, 2>();
+                    for (std::int64_t e = 0; e < edge_index.size(1); ++e)
+                    {
+                        const int length = std::snprintf(line.data(), line.size(), "%lld,%lld,%lld,%.7g\n",
+                                                         static_cast<long long>(item.sequence),
+                                                         static_cast<long long>(edge_accessor[0][e]),
+                                                         static_cast<long long>(edge_accessor[1][e]),
+                                                         score_accessor[e][0]);
+                        output.write(line.data(), length);
+                    }
+                    if (prediction_context)
+                    {
+                        prediction_context->fill(item.sequence, edge_index, scores, item.edge_labels, item.output_node_attr);
+                    }
+                    if (item.components.defined())
+                    {
+                        const auto* components = item.components.data_ptr<std::int64_t>();
+                        for (std::int64_t node = 0; node < item.components.size(0); ++node)
+                        {
+                            const int length = std::snprintf(line.data(), line.size(), "%lld,%lld,%lld\n",
+                                                             static_cast<long long>(item.sequence),
+                                                             static_cast<long long>(node),
+                                                             static_cast<long long>(components[node]));
+                            components_output.write(line.data(), length);
+                        }
+                    }
+                    num_scored_edges += edge_index.size(1);
+                });
+                pending.erase(it);
+            }
+        }
+        writer_monitor.finish_thread();
+    });
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    output.close();
+    if (components_output.is_open())
+    {
+        components_output.close();
+    }
+
+    auto finish = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = finish - start;
+    const auto num_scored = static_cast<std::int64_t>(paths.size()) - num_failed;
+    std::cout << "Scored " << num_scored << " graphs (" << num_failed << " failed), "
+              << num_scored_edges << " edges in " << elapsed.count() << " s: "
+              << num_scored / elapsed.count() << " graphs/s.\n";
+    reader_monitor.report(std::cout, elapsed.count());
+    batcher_monitor.report(std::cout, elapsed.count());
+    worker_monitor.report(std::cout, elapsed.count());
+    writer_monitor.report(std::cout, elapsed.count());
+
+    return num_failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cstdint>
+#include <stdexcept>
+
+#include "perf_counters.h"
+
+// Graph structure shared by a batch of events that differ only in their node and edge attributes (e.g. a fixed
+// detector geometry). Aggregations become products of sparse matrices with the features of all events at once:
+// index traffic is paid once per batch instead of once per event.
+struct SharedTopology
+{
+    torch::Tensor sources;         // [E], edge_index[0]
+    torch::Tensor targets;         // [E], edge_index[1]
+    torch::Tensor incoming;        // sparse [N, N]: entry (target, source) is the edge weight
+    torch::Tensor outgoing;        // sparse [N, N]: entry (source, target) is the edge weight
+    torch::Tensor incoming_edges;  // sparse [N, E]: entry (target, edge) is the edge weight
+    torch::Tensor outgoing_edges;  // sparse [N, E]: entry (source, edge) is the edge weight
+    int64_t num_nodes = 0;
+    int64_t num_edges = 0;
+};
+
+// edge_weight is [E, 1] and shared by all events; parallel edges are summed, as index_add_ does.
+inline SharedTopology make_shared_topology(torch::Tensor edge_index, torch::Tensor edge_weight, const int64_t num_nodes)
+{
+    if (edge_index.dim() != 2 || edge_index.size(0) != 2 || edge_weight.size(0) != edge_index.size(1))
+    {
+        throw std::invalid_argument("make_shared_topology: edge_index must be [2, E] and edge_weight have one row per edge.");
+    }
+
+    SharedTopology topology;
+    topology.num_nodes = num_nodes;
+    topology.num_edges = edge_index.size(1);
+    topology.sources = edge_index[0].contiguous();
+    topology.targets = edge_index[1].contiguous();
+
+    auto weights = edge_weight.detach().reshape({-1}).to(torch::kFloat);
+    auto edges = torch::arange(topology.num_edges, torch::kLong);
+    const auto sparse = [&](torch::Tensor rows, torch::Tensor columns, const int64_t num_columns)
+    {
+        return torch::sparse_coo_tensor(torch::stack({rows, columns}), weights, {num_nodes, num_columns}).coalesce();
+    };
+    topology.incoming = sparse(topology.targets, topology.sources, num_nodes);
+    topology.outgoing = sparse(topology.sources, topology.targets, num_nodes);
+    topology.incoming_edges = sparse(topology.targets, edges, topology.num_edges);
+    topology.outgoing_edges = sparse(topology.sources, edges, topology.num_edges);
+    return topology;
+}
+
+// Multiplies a sparse [N, M] matrix with event-batched features [M, B, F], viewed as one dense [M, B * F] matrix.
+inline torch::Tensor shared_propagate(const torch::Tensor& matrix, const torch::Tensor& features)
+{
+    PerfScope scope(PerfRegion::aggregate);
+    auto dense = features.contiguous().view({features.size(0), -1});
+    return torch::mm(matrix, dense).view({matrix.size(0), features.size(1), features.size(2)});
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Output sinks whose implementations need ROOT. Only these interfaces are visible to the executables; the
+// implementations live in the root_plugin module, which is loaded on first use (see root_plugin.h).
+
+struct MetricsRecord
+{
+    enum Kind : int
+    {
+        step = 0,
+        epoch = 1
+    };
+
+    int kind = step;
+    int epoch = 0;
+    std::int64_t step_index = 0;
+    float loss = 0.0f;
+    float metric = 0.0f;
+    float lr = 0.0f;
+    double step_time = 0.0;   // seconds spent on the step, or on the whole epoch for epoch records
+    double throughput = 0.0;  // graphs per second
+};
+
+class MetricsSink
+{
+public:
+    virtual ~MetricsSink() = default;
+
+    // Never blocks; returns false if the record had to be dropped.
+    virtual bool record(MetricsRecord record) = 0;
+
+    virtual void close() = 0;
+
+    virtual std::uint64_t dropped() const = 0;
+};
+
+class PredictionSinkContext
+{
+public:
+    virtual ~PredictionSinkContext() = default;
+
+    virtual void fill(std::int64_t graph_id, torch::Tensor edge_index, torch::Tensor scores,
+                      torch::Tensor edge_labels = torch::Tensor(), torch::Tensor output_node_attr = torch::Tensor()) = 0;
+};
+
+class PredictionSink
+{
+public:
+    virtual ~PredictionSink() = default;
+
+    virtual bool writes_embeddings() const = 0;
+
+    // One context per filling thread; contexts must be destroyed before their sink.
+    virtual std::unique_ptr<PredictionSinkContext> make_context() = 0;
+
+    virtual void fill_parallel(std::int64_t graph_id, torch::Tensor edge_index, torch::Tensor scores,
+                               torch::Tensor edge_labels = torch::Tensor(), torch::Tensor output_node_attr = torch::Tensor()) = 0;
+};
+
+// One curve of a scaling study. Curves with the same group are drawn on the same canvases.
+struct ScalingCurve
+{
+    std::string group;  // e.g. "threads_strong"
+    std::string name;   // legend entry, e.g. "geometric N=300"
+    std::vector<double> workers;
+    std::vector<double> speedup;
+    std::vector<double> efficiency;
+};
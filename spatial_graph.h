@@ -0,0 +1,525 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "graph.h"
+
+// Graphs from node coordinates: k-nearest-neighbour graphs over a KD-tree and radius graphs over uniform grid cell
+// lists. Both indexes store the points coordinate-major (one float array per axis) in index order, so the
+// distances from a query to a run of candidates vectorize; indexes are built and queried in parallel.
+namespace spatial_detail
+{
+// Up to three coordinates per point, missing ones zero; ids maps storage order back to node indices.
+struct PointSet
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<std::int64_t> ids;
+
+    std::int64_t size() const
+    {
+        return static_cast<std::int64_t>(ids.size());
+    }
+
+    float coordinate(const int axis, const std::int64_t i) const
+    {
+        return axis == 0 ? x[i] : axis == 1 ? y[i] : z[i];
+    }
+};
+
+// Copies the first `dims` columns of a row-major [n, stride] buffer, rows taken in `order`.
+inline PointSet gather_points(const float* data, const std::int64_t stride, const int dims, const std::vector<std::int64_t>& order)
+{
+    const auto n = static_cast<std::int64_t>(order.size());
+    PointSet points;
+    points.x.assign(n, 0.0f);
+    points.y.assign(n, 0.0f);
+    points.z.assign(n, 0.0f);
+    points.ids = order;
+    at::parallel_for(0, n, 4096, [&](std::int64_t begin, std::int64_t end)
+    {
+        for (auto i = begin; i < end; ++i)
+        {
+            const float* row = data + order[i] * stride;
+            points.x[i] = row[0];
+            points.y[i] = dims > 1 ? row[1] : 0.0f;
+            points.z[i] = dims > 2 ? row[2] : 0.0f;
+        }
+    });
+    return points;
+}
+
+// Squared distances from (qx, qy, qz) to the stored points [begin, end).
+inline void squared_distances(const PointSet& points, const std::int64_t begin, const std::int64_t end,
+                              const float qx, const float qy, const float qz, float* distances)
+{
+    const float* x = points.x.data() + begin;
+    const float* y = points.y.data() + begin;
+    const float* z = points.z.data() + begin;
+    const auto n = end - begin;
+#pragma omp simd
+    for (std::int64_t j = 0; j < n; ++j)
+    {
+        const float dx = x[j] - qx;
+        const float dy = y[j] - qy;
+        const float dz = z[j] - qz;
+        distances[j] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+// Edges as two index vectors; blocks of queries fill their own lists, which are concatenated in block order.
+struct EdgeList
+{
+    std::vector<std::int64_t> sources;
+    std::vector<std::int64_t> targets;
+};
+
+inline EdgeList concatenate(std::vector<EdgeList>& blocks)
+{
+    std::vector<std::size_t> offsets(blocks.size() + 1, 0);
+    for (std::size_t b = 0; b < blocks.size(); ++b)
+    {
+        offsets[b + 1] = offsets[b] + blocks[b].sources.size();
+    }
+
+    EdgeList edges;
+    edges.sources.resize(offsets.back());
+    edges.targets.resize(offsets.back());
+    at::parallel_for(0, static_cast<std::int64_t>(blocks.size()), 1, [&](std::int64_t begin, std::int64_t end)
+    {
+        for (auto b = begin; b < end; ++b)
+        {
+            std::copy(blocks[b].sources.begin(), blocks[b].sources.end(), edges.sources.begin() + offsets[b]);
+            std::copy(blocks[b].targets.begin(), blocks[b].targets.end(), edges.targets.begin() + offsets[b]);
+            blocks[b] = EdgeList();
+        }
+    });
+    return edges;
+}
+
+// Points bucketed by a counting sort into cubic cells of at least the search radius, so all neighbours of a point
+// lie in its own or the 26 adjacent cells. z is the fastest-varying cell coordinate: the three cells along z of
+// each (x, y) column are one contiguous run of points.
+class CellGrid
+{
+public:
+    CellGrid(const float* data, const std::int64_t n, const std::int64_t stride, const int dims, const float radius)
+    {
+        float lower[3] = {0.0f, 0.0f, 0.0f};
+        float upper[3] = {0.0f, 0.0f, 0.0f};
+        for (int axis = 0; axis < dims; ++axis)
+        {
+            lower[axis] = std::numeric_limits<float>::max();
+            upper[axis] = std::numeric_limits<float>::lowest();
+        }
+        for (std::int64_t i = 0; i < n; ++i)
+        {
+            for (int axis = 0; axis < dims; ++axis)
+            {
+                lower[axis] = std::min(lower[axis], data[i * stride + axis]);
+                upper[axis] = std::max(upper[axis], data[i * stride + axis]);
+            }
+        }
+
+        // Sparse clouds would need far more cells than points; coarser cells keep the grid O(n).
+        float largest = 0.0f;
+        for (int axis = 0; axis < dims; ++axis)
+        {
+            largest = std::max(largest, upper[axis] - lower[axis]);
+        }
+        cell_size = std::max({radius, largest * 1e-6f, std::numeric_limits<float>::min()});
+        const double max_cells = 2.0 * static_cast<double>(n) + 64.0;
+        while (true)
+        {
+            double cells = 1.0;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                extent[axis] = static_cast<std::int64_t>(std::floor((upper[axis] - lower[axis]) / cell_size)) + 1;
+                cells *= static_cast<double>(extent[axis]);
+            }
+            if (cells <= max_cells)
+            {
+                break;
+            }
+            cell_size *= 1.25f;
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            origin[axis] = lower[axis];
+        }
+
+        std::vector<std::int64_t> cells(n);
+        at::parallel_for(0, n, 4096, [&](std::int64_t begin, std::int64_t end)
+        {
+            for (auto i = begin; i < end; ++i)
+            {
+                const float* row = data + i * stride;
+                cells[i] = cell_of(row[0], dims > 1 ? row[1] : 0.0f, dims > 2 ? row[2] : 0.0f);
+            }
+        });
+
+        cell_offsets.assign(extent[0] * extent[1] * extent[2] + 1, 0);
+        for (const auto cell : cells)
+        {
+            ++cell_offsets[cell + 1];
+        }
+        for (std::size_t c = 1; c < cell_offsets.size(); ++c)
+        {
+            cell_offsets[c] += cell_offsets[c - 1];
+        }
+        std::vector<std::int64_t> order(n);
+        std::vector<std::int64_t> next(cell_offsets.begin(), cell_offsets.end() - 1);
+        for (std::int64_t i = 0; i < n; ++i)
+        {
+            order[next[cells[i]]++] = i;
+        }
+        points = gather_points(data, stride, dims, order);
+    }
+
+    // Emits every pair within the radius once, from the higher to the lower node index.
+    EdgeList pairs_within(const float radius) const
+    {
+        const float radius_squared = radius * radius;
+        const auto n = points.size();
+        const std::int64_t block_size = 4096;
+        std::vector<EdgeList> blocks((n + block_size - 1) / block_size);
+        at::parallel_for(0, static_cast<std::int64_t>(blocks.size()), 1, [&](std::int64_t first_block, std::int64_t last_block)
+        {
+            std::vector<float> distances;
+            for (auto b = first_block; b < last_block; ++b)
+            {
+                auto& block = blocks[b];
+                for (auto p = b * block_size; p < std::min(n, (b + 1) * block_size); ++p)
+                {
+                    const float qx = points.x[p];
+                    const float qy = points.y[p];
+                    const float qz = points.z[p];
+                    const auto query = points.ids[p];
+                    const auto cell = cell_of(qx, qy, qz);
+                    const auto cz = cell % extent[2];
+                    const auto cy = (cell / extent[2]) % extent[1];
+                    const auto cx = cell / (extent[2] * extent[1]);
+                    for (auto ix = std::max<std::int64_t>(0, cx - 1); ix <= std::min(extent[0] - 1, cx + 1); ++ix)
+                    {
+                        for (auto iy = std::max<std::int64_t>(0, cy - 1); iy <= std::min(extent[1] - 1, cy + 1); ++iy)
+                        {
+                            const auto column = (ix * extent[1] + iy) * extent[2];
+                            const auto begin = cell_offsets[column + std::max<std::int64_t>(0, cz - 1)];
+                            const auto end = cell_offsets[column + std::min(extent[2] - 1, cz + 1) + 1];
+                            distances.resize(std::max<std::size_t>(distances.size(), end - begin));
+                            squared_distances(points, begin, end, qx, qy, qz, distances.data());
+                            for (auto j = begin; j < end; ++j)
+                            {
+                                if (distances[j - begin] <= radius_squared && points.ids[j] < query)
+                                {
+                                    block.sources.push_back(query);
+                                    block.targets.push_back(points.ids[j]);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        });
+        return concatenate(blocks);
+    }
+
+private:
+    std::int64_t cell_of(const float px, const float py, const float pz) const
+    {
+        const float position[3] = {px, py, pz};
+        std::int64_t cell = 0;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const auto index = static_cast<std::int64_t>((position[axis] - origin[axis]) / cell_size);
+            cell = cell * extent[axis] + std::min(std::max<std::int64_t>(index, 0), extent[axis] - 1);
+        }
+        return cell;
+    }
+
+    PointSet points;
+    std::vector<std::int64_t> cell_offsets;
+    std::int64_t extent[3] = {1, 1, 1};
+    float origin[3] = {0.0f, 0.0f, 0.0f};
+    float cell_size = 1.0f;
+};
+
+// Balanced KD-tree in heap layout (the children of node i are 2i + 1 and 2i + 2). Every node halves its range at
+// the median of its widest axis, so node ranges depend only on the point count and each level is built with one
+// parallel pass over its nodes. Leaves hold at most leaf_size points, stored contiguously.
+class KDTree
+{
+public:
+    KDTree(const float* data, const std::int64_t n, const std::int64_t stride, const int dims, const std::int64_t leaf_size = 16)
+    {
+        this->leaf_size = std::max<std::int64_t>(1, leaf_size);
+        std::int64_t depth = 0;
+        while ((n + (std::int64_t(1) << depth) - 1) >> depth > this->leaf_size)
+        {
+            ++depth;
+        }
+        const auto num_nodes = (std::int64_t(1) << (depth + 1)) - 1;
+        split_axis.assign(num_nodes, -1);
+        split_value.assign(num_nodes, 0.0f);
+        node_begin.assign(num_nodes, 0);
+        node_end.assign(num_nodes, 0);
+        node_end[0] = n;
+
+        std::vector<std::int64_t> order(n);
+        for (std::int64_t i = 0; i < n; ++i)
+        {
+            order[i] = i;
+        }
+        const auto coordinate = [&](const std::int64_t i, const int axis)
+        {
+            return axis < dims ? data[i * stride + axis] : 0.0f;
+        };
+
+        std::vector<std::int64_t> level = {0};
+        while (!level.empty())
+        {
+            at::parallel_for(0, static_cast<std::int64_t>(level.size()), 1, [&](std::int64_t first, std::int64_t last)
+            {
+                for (auto l = first; l < last; ++l)
+                {
+                    const auto node = level[l];
+                    const auto begin = node_begin[node];
+                    const auto end = node_end[node];
+                    if (end - begin <= this->leaf_size)
+                    {
+                        continue;
+                    }
+
+                    int axis = 0;
+                    float widest = -1.0f;
+                    for (int a = 0; a < dims; ++a)
+                    {
+                        float lower = std::numeric_limits<float>::max();
+                        float upper = std::numeric_limits<float>::lowest();
+                        for (auto i = begin; i < end; ++i)
+                        {
+                            lower = std::min(lower, coordinate(order[i], a));
+                            upper = std::max(upper, coordinate(order[i], a));
+                        }
+                        if (upper - lower > widest)
+                        {
+                            widest = upper - lower;
+                            axis = a;
+                        }
+                    }
+
+                    const auto middle = begin + (end - begin) / 2;
+                    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                                     [&](std::int64_t a, std::int64_t b) { return coordinate(a, axis) < coordinate(b, axis); });
+                    split_axis[node] = axis;
+                    split_value[node] = coordinate(order[middle], axis);
+                    node_begin[2 * node + 1] = begin;
+                    node_end[2 * node + 1] = middle;
+                    node_begin[2 * node + 2] = middle;
+                    node_end[2 * node + 2] = end;
+                }
+            });
+
+            std::vector<std::int64_t> children;
+            for (const auto node : level)
+            {
+                if (split_axis[node] >= 0)
+                {
+                    children.push_back(2 * node + 1);
+                    children.push_back(2 * node + 2);
+                }
+            }
+            level.swap(children);
+        }
+        points = gather_points(data, stride, dims, order);
+    }
+
+    // The k nearest other points of every point, as edges from the neighbour to the query; row i * k' + m of the
+    // result is the m-th nearest neighbour of node i, with k' = min(k, n - 1).
+    EdgeList nearest_neighbours(const std::int64_t k) const
+    {
+        const auto n = points.size();
+        const auto neighbours = std::min(k, std::max<std::int64_t>(0, n - 1));
+        EdgeList edges;
+        edges.sources.resize(n * neighbours);
+        edges.targets.resize(n * neighbours);
+        if (neighbours == 0)
+        {
+            return edges;
+        }
+
+        at::parallel_for(0, n, 256, [&](std::int64_t first, std::int64_t last)
+        {
+            std::vector<float> best_distance(neighbours);
+            std::vector<std::int64_t> best_id(neighbours);
+            std::vector<float> distances(leaf_size);
+            std::vector<SearchRegion> stack;
+            // Queries in tree order, so consecutive queries visit the same leaves.
+            for (auto p = first; p < last; ++p)
+            {
+                const float query[3] = {points.x[p], points.y[p], points.z[p]};
+                const auto query_id = points.ids[p];
+                std::int64_t found = 0;
+                stack.assign(1, SearchRegion{0, 0.0f, {0.0f, 0.0f, 0.0f}});
+                while (!stack.empty())
+                {
+                    const auto region = stack.back();
+                    const auto node = region.node;
+                    stack.pop_back();
+                    if (found == neighbours && region.distance >= best_distance[neighbours - 1])
+                    {
+                        continue;
+                    }
+
+                    if (split_axis[node] < 0)
+                    {
+                        const auto begin = node_begin[node];
+                        const auto end = node_end[node];
+                        squared_distances(points, begin, end, query[0], query[1], query[2], distances.data());
+                        for (auto j = begin; j < end; ++j)
+                        {
+                            const float distance = distances[j - begin];
+                            if (points.ids[j] == query_id || (found == neighbours && distance >= best_distance[neighbours - 1]))
+                            {
+                                continue;
+                            }
+                            // Insertion into the sorted candidate list, dropping the farthest when it is full.
+                            auto slot = std::min(found, neighbours - 1);
+                            while (slot > 0 && best_distance[slot - 1] > distance)
+                            {
+                                best_distance[slot] = best_distance[slot - 1];
+                                best_id[slot] = best_id[slot - 1];
+                                --slot;
+                            }
+                            best_distance[slot] = distance;
+                            best_id[slot] = points.ids[j];
+                            found = std::min(found + 1, neighbours);
+                        }
+                        continue;
+                    }
+
+                    // The far child's region is no closer than the near one's, with this axis' offset replaced.
+                    const auto axis = split_axis[node];
+                    const float offset = query[axis] - split_value[node];
+                    auto far = region;
+                    far.node = offset < 0.0f ? 2 * node + 2 : 2 * node + 1;
+                    far.distance += offset * offset - region.offsets[axis] * region.offsets[axis];
+                    far.offsets[axis] = offset;
+                    stack.push_back(far);
+                    stack.push_back(SearchRegion{offset < 0.0f ? 2 * node + 1 : 2 * node + 2, region.distance,
+                                                 {region.offsets[0], region.offsets[1], region.offsets[2]}});
+                }
+
+                for (std::int64_t m = 0; m < neighbours; ++m)
+                {
+                    edges.sources[query_id * neighbours + m] = best_id[m];
+                    edges.targets[query_id * neighbours + m] = query_id;
+                }
+            }
+        });
+        return edges;
+    }
+
+private:
+    // A subtree still to visit with a lower bound of its squared distance to the query, accumulated from the
+    // per-axis offsets to the splitting planes that bound it.
+    struct SearchRegion
+    {
+        std::int64_t node;
+        float distance;
+        float offsets[3];
+    };
+
+    PointSet points;
+    std::vector<int> split_axis;
+    std::vector<float> split_value;
+    std::vector<std::int64_t> node_begin;
+    std::vector<std::int64_t> node_end;
+    std::int64_t leaf_size = 16;
+};
+
+inline torch::Tensor to_edge_index(const EdgeList& edges)
+{
+    const auto num_edges = static_cast<std::int64_t>(edges.sources.size());
+    auto edge_index = torch::empty({2, num_edges}, torch::kLong);
+    std::copy(edges.sources.begin(), edges.sources.end(), edge_index[0].data_ptr<std::int64_t>());
+    std::copy(edges.targets.begin(), edges.targets.end(), edge_index[1].data_ptr<std::int64_t>());
+    return edge_index;
+}
+
+inline torch::Tensor coordinates(torch::Tensor positions, const std::string& origin)
+{
+    if (positions.dim() != 2 || positions.size(1) < 1 || positions.size(1) > 3)
+    {
+        throw std::invalid_argument(origin + ": positions must be [N, D] with D between one and three.");
+    }
+    return positions.to(torch::kFloat).contiguous();
+}
+} // namespace spatial_detail
+
+// Edges from each node's k nearest neighbours (Euclidean, excluding itself) to the node: [2, N * min(k, N - 1)].
+inline torch::Tensor knn_graph(torch::Tensor positions, const std::int64_t k)
+{
+    auto points = spatial_detail::coordinates(positions, "knn_graph");
+    spatial_detail::KDTree tree(points.data_ptr<float>(), points.size(0), points.size(1), static_cast<int>(points.size(1)));
+    return spatial_detail::to_edge_index(tree.nearest_neighbours(k));
+}
+
+// One edge per node pair at most `radius` apart, from the higher to the lower node index.
+inline torch::Tensor radius_graph(torch::Tensor positions, const double radius)
+{
+    if (!(radius >= 0.0))
+    {
+        throw std::invalid_argument("radius_graph: radius must be non-negative.");
+    }
+    auto points = spatial_detail::coordinates(positions, "radius_graph");
+    spatial_detail::CellGrid grid(points.data_ptr<float>(), points.size(0), points.size(1), static_cast<int>(points.size(1)),
+                                  static_cast<float>(radius));
+    return spatial_detail::to_edge_index(grid.pairs_within(static_cast<float>(radius)));
+}
+
+struct SpatialGraphOptions
+{
+    std::string method = "knn";  // "knn" or "radius"
+    std::int64_t k = 8;
+    double radius = 0.1;
+    int dims = 3;                // leading node_attr columns holding the coordinates
+};
+
+// Unlabelled graph on a point cloud: edges from the spatial neighbourhoods of the coordinates, edge attributes
+// the source minus target node attributes and unit edge weights.
+inline Graph spatial_graph(torch::Tensor node_attr, const SpatialGraphOptions& options)
+{
+    if (options.dims < 1 || options.dims > node_attr.size(1))
+    {
+        throw std::invalid_argument("spatial_graph: dims must be between one and the node attribute size.");
+    }
+
+    auto positions = node_attr.narrow(1, 0, options.dims);
+    Graph graph;
+    graph.node_attr = node_attr;
+    if (options.method == "knn")
+    {
+        graph.edge_index = knn_graph(positions, options.k);
+    }
+    else if (options.method == "radius")
+    {
+        graph.edge_index = radius_graph(positions, options.radius);
+    }
+    else
+    {
+        throw std::invalid_argument("spatial_graph: method must be knn or radius.");
+    }
+    graph.edge_attr = node_attr.index_select(0, graph.edge_index[0]) - node_attr.index_select(0, graph.edge_index[1]);
+    graph.edge_weight = torch::ones({graph.edge_index.size(1), 1}, node_attr.options());
+    return graph;
+}
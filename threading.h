@@ -0,0 +1,51 @@
+#pragma once
+
+#include <torch/torch.h>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+#include <thread>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Limits the intra-op parallelism of operators launched from the calling thread. at::set_num_threads() is
+// process-wide, but with the OpenMP backend the team size of a parallel region is a per-thread setting, so
+// worker threads can run narrow while another thread keeps the full pool. Without OpenMP this is a no-op.
+inline void set_intra_op_threads_for_current_thread(const int num_threads)
+{
+    // The first parallel region of a thread calls at::init_num_threads(), which resets the OpenMP team size to
+    // the global thread count. Running the lazy initialization now (it marks the thread as initialized, which a
+    // direct at::init_num_threads() does not) keeps it from overwriting the setting later.
+    at::internal::lazy_init_num_threads();
+#ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+#else
+    (void)num_threads;
+#endif
+}
+
+// Pins the calling thread to one core; returns false where affinity cannot be set (e.g. restricted containers).
+inline bool pin_current_thread(const unsigned core)
+{
+    const unsigned num_cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(core % num_cores, &cpu_set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}
+
+// Pins the calling thread to cores [first, last). Threads it creates afterwards, such as the OpenMP team of its
+// parallel regions, inherit the mask.
+inline bool pin_current_thread_to_cores(const unsigned first, const unsigned last)
+{
+    const unsigned num_cores = std::max(1u, std::thread::hardware_concurrency());
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (unsigned core = first; core < last && core < num_cores; ++core)
+    {
+        CPU_SET(core, &cpu_set);
+    }
+    return CPU_COUNT(&cpu_set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+}